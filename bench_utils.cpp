@@ -0,0 +1,384 @@
+/*
+ * bench_utils.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mex_utils.h"
+#include "mat_utils.h"
+
+namespace {
+
+template <typename Function>
+double timeIt(Function function, const int numRepetitions) {
+	const std::chrono::steady_clock::time_point start =
+											std::chrono::steady_clock::now();
+	for (int iter = 0; iter < numRepetitions; ++iter) {
+		function();
+	}
+	const std::chrono::duration<double> elapsed =
+									std::chrono::steady_clock::now() - start;
+	return elapsed.count() / numRepetitions;
+}
+
+/*
+ * Element-by-element permute, as MxNumeric::permute was implemented before
+ * detail::PermutePlan. Kept as the baseline.
+ */
+template <typename NumericType>
+mex::MxNumeric<NumericType> permuteReference(
+								const mex::MxNumeric<NumericType>& array,
+								const std::vector<int>& indexPermutation) {
+	const std::vector<int> dimensions = array.getDimensions();
+	std::vector<int> permutedDimensions(dimensions.size());
+	for (size_t iter = 0, end = dimensions.size(); iter < end; ++iter) {
+		permutedDimensions[iter] = dimensions[indexPermutation[iter] - 1];
+	}
+	mex::MxNumeric<NumericType> retArg(
+								static_cast<int>(permutedDimensions.size()),
+								&permutedDimensions[0]);
+	const NumericType* thisData = array.getData();
+	NumericType* otherData = retArg.getData();
+	for (int iter = 0, end = array.getNumberOfElements(); iter < end; ++iter) {
+		const std::vector<int> subscript = array.ind2sub(iter);
+		std::vector<int> permutedSubscript(subscript.size());
+		for (size_t iterDim = 0, endDim = subscript.size(); iterDim < endDim;
+			++iterDim) {
+			permutedSubscript[iterDim] =
+									subscript[indexPermutation[iterDim] - 1];
+		}
+		otherData[retArg.sub2ind(permutedSubscript)] = thisData[iter];
+	}
+	return retArg;
+}
+
+void benchPermute(const std::vector<int>& dims,
+				const std::vector<int>& indexPermutation) {
+	mex::MxNumeric<double> array(static_cast<int>(dims.size()), &dims[0]);
+	for (int iter = 0, end = array.getNumberOfElements(); iter < end; ++iter) {
+		array[iter] = iter;
+	}
+	mex::MxNumeric<double> reference = permuteReference(array, indexPermutation);
+	mex::MxNumeric<double> permuted = array.permute(indexPermutation);
+	mexAssertEx((reference.getDimensions() == permuted.getDimensions())
+				&& std::equal(reference.getData(),
+							reference.getData()
+							+ reference.getNumberOfElements(),
+							permuted.getData()),
+				"permute does not match the reference");
+	reference.destroy();
+	permuted.destroy();
+	const double timeReference = timeIt([&array, &indexPermutation]() {
+		permuteReference(array, indexPermutation).destroy();
+	}, 1);
+	const double timePlan = timeIt([&array, &indexPermutation]() {
+		array.permute(indexPermutation).destroy();
+	}, 5);
+	mexPrintf("permute %d-D, %d elements: reference %.4f s, plan %.4f s "
+			"(x%.1f).\n", static_cast<int>(dims.size()),
+			array.getNumberOfElements(), timeReference, timePlan,
+			timeReference / timePlan);
+	array.destroy();
+}
+
+/*
+ * y = a * x + y, through operator[], getData() and an accessor.
+ */
+void benchAccess(const int numel) {
+	mex::MxNumeric<float> x(numel, 1);
+	mex::MxNumeric<float> y(numel, 1);
+	for (int iter = 0; iter < numel; ++iter) {
+		x[iter] = static_cast<float>(iter);
+	}
+	const float alpha = 0.5f;
+	const double timeOperator = timeIt([&x, &y, alpha, numel]() {
+		for (int iter = 0; iter < numel; ++iter) {
+			y[iter] = alpha * x[iter] + y[iter];
+		}
+	}, 10);
+	const double timeData = timeIt([&x, &y, alpha, numel]() {
+		const float* xData = x.getData();
+		float* yData = y.getData();
+		for (int iter = 0; iter < numel; ++iter) {
+			yData[iter] = alpha * xData[iter] + yData[iter];
+		}
+	}, 10);
+	const double timeAccessor = timeIt([&x, &y, alpha, numel]() {
+		const mex::MxNumericAccessor<const float> xAccessor(x);
+		const mex::MxNumericAccessor<float> yAccessor = y.getAccessor();
+		for (int iter = 0; iter < numel; ++iter) {
+			yAccessor[iter] = alpha * xAccessor[iter] + yAccessor[iter];
+		}
+	}, 10);
+	mexPrintf("axpy, %d elements: operator[] %.4f s, getData() %.4f s, "
+			"accessor %.4f s.\n", numel, timeOperator, timeData, timeAccessor);
+	x.destroy();
+	y.destroy();
+}
+
+/*
+ * Construction of a numeric array, zero-filled and uninitialized, with and
+ * without copying in existing data.
+ */
+void benchConstruction(const mwSize numel) {
+	const std::vector<double> source(numel, 1.0);
+	const mwSize dims[2] = {numel, 1};
+	const double timeZeroed = timeIt([&dims]() {
+		mex::MxNumeric<double>(static_cast<mwSize>(2), dims).destroy();
+	}, 5);
+	const double timeUninitialized = timeIt([&dims]() {
+		mex::MxNumeric<double>(mex::kUninitialized, static_cast<mwSize>(2),
+								dims).destroy();
+	}, 5);
+	const double timeZeroedCopy = timeIt([&source, &dims]() {
+		mex::MxNumeric<double> array(static_cast<mwSize>(2), dims);
+		std::memcpy(static_cast<void*>(array.getData()),
+					static_cast<const void*>(source.data()),
+					source.size() * sizeof(double));
+		array.destroy();
+	}, 5);
+	const double timeCopy = timeIt([&source]() {
+		mex::MxNumeric<double>(source).destroy();
+	}, 5);
+	const double timeParallelCopy = timeIt([&source]() {
+		mex::MxNumeric<double>(mex::kParallel, source).destroy();
+	}, 5);
+	mexPrintf("construction, %d elements: zeroed %.4f s, uninitialized %.4f s, "
+			"zeroed + copy %.4f s, copy constructor %.4f s, parallel copy "
+			"constructor %.4f s.\n", static_cast<int>(numel), timeZeroed,
+			timeUninitialized, timeZeroedCopy, timeCopy, timeParallelCopy);
+}
+
+/*
+ * One scalar field of a struct array read into a vector, record by record
+ * through MxNumeric, and with MxStructArray::gatherField.
+ */
+void benchStructGather(const int numRecords) {
+	mex::MxStructArray records(numRecords, std::vector<std::string>{"value"});
+	records.scatterField(0, std::vector<double>(numRecords, 1.0));
+	std::vector<double> values(numRecords);
+	const double timeRecord = timeIt([&records, &values, numRecords]() {
+		for (int iter = 0; iter < numRecords; ++iter) {
+			values[iter] = mex::MxNumeric<double>(records(iter, 0))[0];
+		}
+	}, 5);
+	const double timeGather = timeIt([&records, &values]() {
+		records.gatherField(0, values);
+	}, 5);
+	mexPrintf("struct field, %d records: per record %.4f s, gatherField %.4f s.\n",
+			numRecords, timeRecord, timeGather);
+	records.destroy();
+}
+
+/*
+ * Sparse matrix with numNonzeros random entries, built from triplets, times a
+ * vector and times its transpose.
+ */
+void benchSparse(const mwSize numRows, const mwSize numNonzeros) {
+	std::vector<mwSize> rowIndices(numNonzeros);
+	std::vector<mwSize> columnIndices(numNonzeros);
+	std::vector<double> values(numNonzeros, 1.0);
+	std::uint64_t seed = 1;
+	for (mwSize iter = 0; iter < numNonzeros; ++iter) {
+		seed = seed * UINT64_C(6364136223846793005)
+			+ UINT64_C(1442695040888963407);
+		rowIndices[iter] = (seed >> 33) % numRows;
+		columnIndices[iter] = (seed >> 13) % numRows;
+	}
+	mex::MxSparse<double> matrix;
+	const double timeBuild = timeIt([&]() {
+		matrix = mex::MxSparse<double>(numRows, numRows, rowIndices,
+									columnIndices, values);
+	}, 1);
+	mex::MxNumeric<double> x(std::vector<double>(numRows, 1.0));
+	const double timeMultiply = timeIt([&matrix, &x]() {
+		matrix.multiply(x).destroy();
+	}, 5);
+	const double timeTransposeMultiply = timeIt([&matrix, &x]() {
+		matrix.transposeMultiply(x).destroy();
+	}, 5);
+	mexPrintf("sparse, %d rows, %d nonzeros: triplets %.4f s, A * x %.4f s, "
+			"A.' * x %.4f s.\n", static_cast<int>(numRows),
+			matrix.getNumberOfNonzeros(), timeBuild, timeMultiply,
+			timeTransposeMultiply);
+	matrix.destroy();
+	x.destroy();
+}
+
+typedef mex::Signature<mex::In<mex::MxNumeric<double>, mex::Dims<-1, 3> >,
+					mex::In<mex::MxString>,
+					mex::Out<mex::MxStruct> > BenchSignature;
+
+/*
+ * Per-call cost of validating and wrapping the arguments of a mex function,
+ * with a Signature and with the equivalent hand-written checks.
+ */
+void benchSignature(const int numCalls) {
+	mex::MxNumeric<double> points(100, 3);
+	mex::MxString name("points");
+	const mxArray* prhs[2] = {points.get_array(), name.get_array()};
+	double checksum = 0;
+	const double timeHand = timeIt([&prhs, &checksum]() {
+		if (!mxIsDouble(prhs[0]) || mxIsComplex(prhs[0]) || mxIsSparse(prhs[0])
+			|| (mxGetNumberOfDimensions(prhs[0]) != 2)
+			|| (mxGetN(prhs[0]) != 3) || !mxIsChar(prhs[1])) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Invalid arguments.\n");
+		}
+		const mex::MxNumeric<double> points(const_cast<mxArray*>(prhs[0]));
+		const mex::MxString name(const_cast<mxArray*>(prhs[1]));
+		checksum += points.getData()[0] + name.getNumberOfElements();
+	}, numCalls);
+	const double timeSignature = timeIt([&prhs, &checksum]() {
+		const BenchSignature::InputTuple inputs = BenchSignature::parse(1, 2,
+																		prhs);
+		checksum += std::get<0>(inputs).getData()[0]
+				+ std::get<1>(inputs).getNumberOfElements();
+	}, numCalls);
+	mexPrintf("argument checks (%g): hand-written %.3g s, Signature %.3g s.\n",
+			checksum, timeHand, timeSignature);
+	points.destroy();
+	name.destroy();
+}
+
+enum BenchMode {
+	kBenchFast,
+	kBenchExact,
+	kBenchRobust,
+	kBenchApproximate
+};
+
+/*
+ * Option table built and queried once per call, as in a mex entry point,
+ * with ConstBiMap and with a constexpr ConstFlatMap.
+ */
+void benchOptionLookup(const int numCalls) {
+	const std::string option("approximate");
+	int checksum = 0;
+	const double timeMap = timeIt([&option, &checksum]() {
+		const mex::ConstBiMap<std::string, BenchMode> modes =
+					mex::ConstBiMap<std::string, BenchMode>("fast", kBenchFast)
+													("exact", kBenchExact)
+													("robust", kBenchRobust)
+													("approximate",
+													kBenchApproximate);
+		checksum += modes[option];
+	}, numCalls);
+	const double timeFlatMap = timeIt([&option, &checksum]() {
+		static constexpr auto kModes = mex::makeConstMap("fast", kBenchFast)
+													("exact", kBenchExact)
+													("robust", kBenchRobust)
+													("approximate",
+													kBenchApproximate);
+		checksum += kModes[option];
+	}, numCalls);
+	mexPrintf("option lookup (%d): ConstBiMap %.3g s, ConstFlatMap %.3g s.\n",
+			checksum, timeMap, timeFlatMap);
+}
+
+/*
+ * Saving a numeric array to a v7 MAT file with MatParallelOutputFile, at the
+ * store-only, fastest, and default compression levels.
+ */
+void benchParallelSave(const mwSize numel) {
+	mex::MxNumeric<double> array(numel, static_cast<mwSize>(1));
+	for (mwSize iter = 0; iter < numel; ++iter) {
+		array[iter] = static_cast<double>(iter % 1000);
+	}
+	const int levels[3] = {0, 1, Z_DEFAULT_COMPRESSION};
+	double times[3];
+	for (int iter = 0; iter < 3; ++iter) {
+		times[iter] = timeIt([&array, &levels, iter]() {
+			mex::MatParallelOutputFile file("bench_utils.mat", levels[iter]);
+			file.writeVariable(array, "array");
+			file.flush();
+		}, 3);
+	}
+	mexPrintf("parallel save, %d elements: store %.4f s, level 1 %.4f s, "
+			"default level %.4f s.\n", static_cast<int>(numel), times[0],
+			times[1], times[2]);
+	array.destroy();
+}
+
+/*
+ * Loading numVariables compressed variables, spread over numFiles v7 MAT
+ * files, one at a time with MatInputFile::readVariable, and in one batch
+ * with loadNumericVariables on 1, 2, 4, ... threads up to all of them.
+ */
+void benchBatchLoad(const int numFiles, const int numVariables,
+					const mwSize numel) {
+	mex::MxNumeric<double> array(numel, static_cast<mwSize>(1));
+	for (mwSize iter = 0; iter < numel; ++iter) {
+		array[iter] = static_cast<double>(iter % 1000);
+	}
+	std::vector<mex::MatLoadRequest> requests;
+	for (int iterFile = 0; iterFile < numFiles; ++iterFile) {
+		const std::string fileName = "bench_utils_"
+									+ std::to_string(iterFile) + ".mat";
+		mex::MatParallelOutputFile file(fileName);
+		for (int iter = iterFile; iter < numVariables; iter += numFiles) {
+			const std::string variableName = "array" + std::to_string(iter);
+			file.writeVariable(array, variableName);
+			requests.push_back(mex::MatLoadRequest{fileName, variableName});
+		}
+		file.flush();
+	}
+	array.destroy();
+	const double timeSequential = timeIt([&requests]() {
+		for (size_t iter = 0, end = requests.size(); iter < end; ++iter) {
+			const mex::MatInputFile file(requests[iter].m_fileName);
+			file.readVariable(requests[iter].m_variableName).destroy();
+		}
+	}, 1);
+	mexPrintf("batch load, %d variables of %d elements in %d files: "
+			"readVariable %.4f s.\n", numVariables, static_cast<int>(numel),
+			numFiles, timeSequential);
+	const int maxThreads = static_cast<int>(mex::detail::getMaxThreads());
+	for (int numThreads = 1; ; numThreads = std::min(2 * numThreads,
+													maxThreads)) {
+#ifdef _OPENMP
+		omp_set_num_threads(numThreads);
+#endif
+		const double timeBatch = timeIt([&requests]() {
+			std::vector<mex::MxNumeric<double> > loaded =
+								mex::loadNumericVariables<double>(requests);
+			for (size_t iter = 0, end = loaded.size(); iter < end; ++iter) {
+				loaded[iter].destroy();
+			}
+		}, 1);
+		mexPrintf("  loadNumericVariables, %d threads: %.4f s (%.2fx).\n",
+				numThreads, timeBatch, timeSequential / timeBatch);
+		if (numThreads == maxThreads) {
+			break;
+		}
+	}
+#ifdef _OPENMP
+	omp_set_num_threads(maxThreads);
+#endif
+}
+
+}  // namespace
+
+void mexFunction(int /* nlhs */, mxArray* /* plhs */[], int /* nrhs */,
+				const mxArray* /* prhs */[]) {
+
+	benchPermute({4096, 4096}, {2, 1});
+	benchPermute({256, 256, 256}, {3, 1, 2});
+	benchPermute({256, 256, 256}, {1, 3, 2});
+	benchPermute({64, 64, 64, 64}, {4, 3, 2, 1});
+	benchAccess(1 << 24);
+	benchConstruction(1 << 26);
+	benchStructGather(1 << 20);
+	benchOptionLookup(1 << 20);
+	benchSparse(1 << 20, 1 << 24);
+	benchSignature(1 << 22);
+	benchParallelSave(1 << 26);
+	benchBatchLoad(4, 32, 1 << 21);
+}
@@ -8,10 +8,31 @@
 #ifndef MAT_UTILS_H_
 #define MAT_UTILS_H_
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Reading blocks of v7.3 variables (MatInputFile::readVariableBlock), writing
+ * them in slices (MatOutputFile::createVariableStream), and locating them in
+ * the variable index go through HDF5 directly. They are compiled only if
+ * MAT_UTILS_USE_HDF5 is defined, which also needs linking with libhdf5.
+ */
+#ifdef MAT_UTILS_USE_HDF5
+#include <hdf5.h>
+#endif
+#include <zlib.h>
 
 #include "mat.h"
 #include "mex_utils.h"
@@ -29,9 +50,45 @@
 
 namespace mex {
 
-class Mat
+/*
+ * Entry of the variable index of a MatFile. m_offset and m_size locate the
+ * variable in the file: the whole element in a v5 file, the data of the
+ * dataset in a v7.3 file (m_offset is 0 for chunked datasets, whose data is
+ * not in one place, and both are located only with MAT_UTILS_USE_HDF5). Both
+ * are 0 when not known. Writing or deleting a variable may rewrite the file
+ * and move the others, so after either all entries have both 0.
+ */
+struct MatIndexEntry {
+	MxArrayHeader m_header;
+	size_t m_offset;
+	size_t m_size;
+};
 
+namespace detail {
 
+/*
+ * Version in the header of a MAT file, 0x0100 for v5 (and v7) and 0x0200 for
+ * v7.3; 0 if the file has no such header or is in the other byte order.
+ */
+inline std::uint16_t getMatFileVersion(const std::string& fileName) {
+	char header[128];
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file.read(header, sizeof(header))
+		|| (std::memcmp(header + sizeof(header) - 2, "IM", 2) != 0)) {
+		return 0;
+	}
+	std::uint16_t retArg;
+	std::memcpy(&retArg, header + sizeof(header) - 4, sizeof(retArg));
+	return retArg;
+}
+
+}  // namespace detail
+
+/*
+ * The read and write members are not virtual: MatInputFile and MatOutputFile
+ * delete the ones that do not apply to them, which hides them at compile time
+ * instead of failing at run time.
+ */
 class MatFile {
 public:
 
@@ -50,31 +107,38 @@ public:
 	MatFile& operator=(MatFile&& other) = delete;
 
 	/*
-	 * TODO: Maybe better to implement this by getting name list and scanning
-	 * for queryname.
+	 * Queries about the variables of the file go through an index of their
+	 * headers, built on the first query or write (see buildIndex), before
+	 * libmat may buffer any change to the file, and kept up to date by
+	 * writeVariable and deleteVariable, so that they take constant time and
+	 * do no I/O.
 	 */
-	virtual inline bool hasVariable(const std::string& variableName) const {
-		return (matGetVariableInfo(m_file, variableName.c_str()) != nullptr);
+	inline bool hasVariable(const std::string& variableName) const {
+		return (getIndex().find(variableName) != m_index.end());
 	}
 
-	virtual inline std::vector<std::string> getVariableNames() const {
-		int numberVariables;
-		char** variableNames = (char**) matGetDir(m_file, &numberVariables);
-		mexAssert(variableNames != nullptr);
-		std::vector<std::string> retArg(variableNames,
-										variableNames + numberVariables);
-		mxFree(variableNames);
-		return retArg;
+	inline std::vector<std::string> getVariableNames() const {
+		getIndex();
+		return m_names;
 	}
 
-	virtual inline MxArrayHeader getVariableInfo(const std::string& variableName) const {
-		mxArray* variableHeader = matGetVariableInfo(m_file,
-													variableName.c_str());
-		mexAssert(variableHeader != nullptr);
-		return MxArrayHeader(variableHeader);
+	inline MxArrayHeader getVariableInfo(const std::string& variableName) const {
+		return getVariableEntry(variableName).m_header;
+	}
+
+	inline const MatIndexEntry& getVariableEntry(
+									const std::string& variableName) const {
+		const std::unordered_map<std::string, MatIndexEntry>::const_iterator
+									position = getIndex().find(variableName);
+		mexAssertEx(position != m_index.end(), "No such variable");
+		return position->second;
 	}
 
-	virtual inline MxVariableHeader getNextVariableInfo() const {
+	inline const std::string& getFileName() const {
+		return m_fileName;
+	}
+
+	inline MxVariableHeader getNextVariableInfo() const {
 		const char* variableNameTemp;
 		mxArray* variableHeader = matGetNextVariableInfo(m_file,
 														&variableNameTemp);
@@ -85,18 +149,18 @@ public:
 	}
 
 	template <typename MxArrayType>
-	virtual inline MxArrayType readVariable(const std::string& variableName) const {
+	inline MxArrayType readVariable(const std::string& variableName) const {
 		mxArray* variable = matGetVariable(m_file, variableName.c_str());
 		mexAssert(variable != nullptr);
 		return MxArrayType(variable);
 	}
 
-	virtual inline MxArray readVariable(const std::string& variableName) const {
+	inline MxArray readVariable(const std::string& variableName) const {
 		return readVariable<MxArray>(variableName);
 	}
 
 	template <typename MxArrayType>
-	virtual inline MxVariable readNextVariable() {
+	inline MxVariable readNextVariable() {
 		const char* variableNameTemp;
 		mxArray* variable = matGetNextVariable(m_file, &variableNameTemp);
 		mexAssert(variable != nullptr);
@@ -105,77 +169,2039 @@ public:
 		return MxVariable{variableName, MxArrayType(variable)};
 	}
 
-	virtual inline MxVariable readNextVariable() {
+	inline MxVariable readNextVariable() {
 		return readNextVariable<MxArray>();
 	}
 
 	template <typename MxArrayType>
-	virtual inline void writeVariable(const MxArrayType& variable,
+	inline void writeVariable(const MxArrayType& variable,
 							const std::string& variableName) {
+		getIndex();
 		int errorCode = matPutVariable(m_file, variableName.c_str(),
 									variable.get_array());
 		mexAssert(errorCode == 0);
+		clearLocations();
+		addToIndex(variableName, MatIndexEntry{MxArrayHeader(variable), 0, 0});
 	}
 
-	virtual inline void writeVariable(const MxVariable& variable) {
-		writeVariable(*(variable.m_array), variable.m_name);
+	inline void writeVariable(const MxVariable& variable) {
+		writeVariable(variable.m_array, variable.m_name);
 	}
 
-	virtual inline void deleteVariable(const std::string& variableName) {
+	inline void deleteVariable(const std::string& variableName) {
+		getIndex();
 		int errorCode = matDeleteVariable(m_file, variableName.c_str());
 		mexAssert(errorCode == 0);
+		clearLocations();
+		if (m_index.erase(variableName) > 0) {
+			m_names.erase(std::find(m_names.begin(), m_names.end(),
+									variableName));
+		}
 	}
 
-	~MatFile() {
+	virtual ~MatFile() {
 		int errorCode = matClose(m_file);
 		mexAssert(errorCode == 0);
 	}
 
 protected:
 	MatFile(const char* fileName, const char* accessType) :
-			m_file(matOpen(fileName, accessType)) {
+			m_fileName(fileName),
+			m_file(matOpen(fileName, accessType)),
+			m_isIndexed(accessType[0] == 'w'),
+			m_index(),
+			m_names() {
 		mexAssert(m_file != nullptr);
 	}
 
 private:
+	inline const std::unordered_map<std::string, MatIndexEntry>& getIndex()
+																	const {
+		if (!m_isIndexed) {
+			buildIndex();
+			m_isIndexed = true;
+		}
+		return m_index;
+	}
+
+	inline void addToIndex(const std::string& variableName,
+						const MatIndexEntry& entry) const {
+		if (m_index.erase(variableName) == 0) {
+			m_names.push_back(variableName);
+		}
+		m_index.emplace(variableName, entry);
+	}
+
+	inline void clearLocations() {
+		for (std::unordered_map<std::string, MatIndexEntry>::iterator
+				iter = m_index.begin(), end = m_index.end(); iter != end;
+				++iter) {
+			iter->second.m_offset = 0;
+			iter->second.m_size = 0;
+		}
+	}
+
+	inline void buildIndex() const;
+
+	const std::string m_fileName;
 	/*
 	 * TODO: Maybe declare const.
 	 */
 	MATFile* m_file;
+	mutable bool m_isIndexed;
+	mutable std::unordered_map<std::string, MatIndexEntry> m_index;
+	mutable std::vector<std::string> m_names;
+};
+
+#ifdef MAT_UTILS_USE_HDF5
+namespace detail {
+
+/*
+ * Chunk caches of the datasets kept open for block reads, which share
+ * kHdf5ChunkCacheSize between them. Decompressed chunks stay cached across
+ * reads of neighboring blocks of the same variable.
+ */
+const size_t kHdf5ChunkCacheSize = 1 << 26;
+const size_t kHdf5ChunkCacheSlots = 10007;
+const size_t kHdf5NumCachedDatasets = 4;
+
+template <typename NumericType>
+struct Hdf5Type;
+
+template <>
+struct Hdf5Type<bool> {
+	static inline hid_t get() {
+		return H5T_NATIVE_UINT8;
+	}
+};
+
+template <>
+struct Hdf5Type<INT8_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_INT8;
+	}
+};
+
+template <>
+struct Hdf5Type<UINT8_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_UINT8;
+	}
+};
+
+template <>
+struct Hdf5Type<INT16_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_INT16;
+	}
+};
+
+template <>
+struct Hdf5Type<UINT16_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_UINT16;
+	}
+};
+
+template <>
+struct Hdf5Type<INT32_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_INT32;
+	}
+};
+
+template <>
+struct Hdf5Type<UINT32_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_UINT32;
+	}
+};
+
+template <>
+struct Hdf5Type<INT64_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_INT64;
+	}
+};
+
+template <>
+struct Hdf5Type<UINT64_T> {
+	static inline hid_t get() {
+		return H5T_NATIVE_UINT64;
+	}
+};
+
+template <>
+struct Hdf5Type<float> {
+	static inline hid_t get() {
+		return H5T_NATIVE_FLOAT;
+	}
+};
+
+template <>
+struct Hdf5Type<double> {
+	static inline hid_t get() {
+		return H5T_NATIVE_DOUBLE;
+	}
+};
+
+/*
+ * Value of the MATLAB_class attribute that MATLAB attaches to every variable
+ * of a v7.3 file, or an empty string if there is none.
+ */
+inline std::string getHdf5MatlabClass(const hid_t object) {
+	if (H5Aexists(object, "MATLAB_class") <= 0) {
+		return std::string();
+	}
+	const hid_t attribute = H5Aopen(object, "MATLAB_class", H5P_DEFAULT);
+	const hid_t type = H5Aget_type(attribute);
+	std::string retArg(H5Tget_size(type), '\0');
+	const herr_t status = H5Aread(attribute, type, &retArg[0]);
+	H5Tclose(type);
+	H5Aclose(attribute);
+	mexAssert(status >= 0);
+	retArg.resize(std::strlen(retArg.c_str()));
+	return retArg;
+}
+
+/*
+ * Attributes MATLAB needs to load a dataset as a variable: its class and, for
+ * logical arrays, which are stored as uint8, MATLAB_int_decode.
+ */
+inline void setHdf5MatlabClass(const hid_t object, const std::string& className) {
+	const hid_t type = H5Tcopy(H5T_C_S1);
+	H5Tset_size(type, className.size());
+	const hid_t space = H5Screate(H5S_SCALAR);
+	const hid_t attribute = H5Acreate2(object, "MATLAB_class", type, space,
+									H5P_DEFAULT, H5P_DEFAULT);
+	const herr_t status = H5Awrite(attribute, type, className.c_str());
+	H5Aclose(attribute);
+	H5Sclose(space);
+	H5Tclose(type);
+	mexAssert(status >= 0);
+	if (className == "logical") {
+		const INT32_T intDecode = 1;
+		const hid_t intSpace = H5Screate(H5S_SCALAR);
+		const hid_t intAttribute = H5Acreate2(object, "MATLAB_int_decode",
+											H5T_NATIVE_INT32, intSpace,
+											H5P_DEFAULT, H5P_DEFAULT);
+		H5Awrite(intAttribute, H5T_NATIVE_INT32, &intDecode);
+		H5Aclose(intAttribute);
+		H5Sclose(intSpace);
+	}
+}
+
+/*
+ * Target size of the chunks of streamed variables.
+ */
+const size_t kHdf5ChunkBytes = 1 << 20;
+
+/*
+ * Chunk shape for a dataset of dims (HDF5 order, dims[0] being the dimension
+ * written in slices, 0 if unlimited): whole slices if they fit in
+ * kHdf5ChunkBytes, as many of them as fit, otherwise slices cut along their
+ * slowest-varying dimensions.
+ */
+inline std::vector<hsize_t> getHdf5ChunkDims(const std::vector<hsize_t>& dims,
+											const size_t elementSize) {
+	std::vector<hsize_t> retArg(dims);
+	retArg[0] = 1;
+	hsize_t numBytes = elementSize;
+	for (size_t iter = 1, end = retArg.size(); iter < end; ++iter) {
+		retArg[iter] = std::max(retArg[iter], static_cast<hsize_t>(1));
+		numBytes *= retArg[iter];
+	}
+	for (size_t iter = 1, end = retArg.size();
+		(iter < end) && (numBytes > kHdf5ChunkBytes); ++iter) {
+		while ((retArg[iter] > 1) && (numBytes > kHdf5ChunkBytes)) {
+			numBytes /= retArg[iter];
+			retArg[iter] = (retArg[iter] + 1) / 2;
+			numBytes *= retArg[iter];
+		}
+	}
+	retArg[0] = std::max(kHdf5ChunkBytes / numBytes, static_cast<hsize_t>(1));
+	if (dims[0] > 0) {
+		retArg[0] = std::min(retArg[0], dims[0]);
+	}
+	return retArg;
+}
+
+/*
+ * HDF5 handle of a MAT file, opened on first use.
+ */
+class Hdf5File {
+public:
+	Hdf5File() :
+			m_file(-1) {}
+
+	Hdf5File(const Hdf5File& other) = delete;
+	Hdf5File& operator=(const Hdf5File& other) = delete;
+
+	inline hid_t get(const std::string& fileName, const unsigned accessFlags) {
+		if (m_file < 0) {
+			m_file = H5Fopen(fileName.c_str(), accessFlags, H5P_DEFAULT);
+			mexAssertEx(m_file >= 0, "Cannot open MAT file through HDF5; only "
+						"v7.3 files are HDF5");
+		}
+		return m_file;
+	}
+
+	~Hdf5File() {
+		if (m_file >= 0) {
+			H5Fclose(m_file);
+		}
+	}
+
+private:
+	hid_t m_file;
+};
+
+/*
+ * Datasets opened for block reads. The kHdf5NumCachedDatasets most recently
+ * used stay open, most recent first, so that reading blocks from any number
+ * of variables holds at most kHdf5ChunkCacheSize of cached chunks.
+ */
+class Hdf5DatasetCache {
+public:
+	Hdf5DatasetCache() :
+			m_file(),
+			m_datasets() {}
+
+	Hdf5DatasetCache(const Hdf5DatasetCache& other) = delete;
+	Hdf5DatasetCache& operator=(const Hdf5DatasetCache& other) = delete;
+
+	inline hid_t get(const std::string& fileName,
+					const std::string& variableName) {
+		for (size_t iter = 0, end = m_datasets.size(); iter < end; ++iter) {
+			if (m_datasets[iter].first == variableName) {
+				std::rotate(m_datasets.begin(), m_datasets.begin() + iter,
+							m_datasets.begin() + iter + 1);
+				return m_datasets.front().second;
+			}
+		}
+		const hid_t file = m_file.get(fileName, H5F_ACC_RDONLY);
+		mexAssertEx(H5Lexists(file, variableName.c_str(), H5P_DEFAULT) > 0,
+					"No such variable");
+		if (m_datasets.size() == kHdf5NumCachedDatasets) {
+			H5Dclose(m_datasets.back().second);
+			m_datasets.pop_back();
+		}
+		const hid_t accessProperties = H5Pcreate(H5P_DATASET_ACCESS);
+		H5Pset_chunk_cache(accessProperties, kHdf5ChunkCacheSlots,
+						kHdf5ChunkCacheSize / kHdf5NumCachedDatasets,
+						H5D_CHUNK_CACHE_W0_DEFAULT);
+		const hid_t dataset = H5Dopen2(file, variableName.c_str(),
+									accessProperties);
+		H5Pclose(accessProperties);
+		mexAssertEx(dataset >= 0, "Variable is not a numeric array");
+		m_datasets.insert(m_datasets.begin(),
+						std::make_pair(variableName, dataset));
+		return dataset;
+	}
+
+	~Hdf5DatasetCache() {
+		for (size_t iter = 0, end = m_datasets.size(); iter < end; ++iter) {
+			H5Dclose(m_datasets[iter].second);
+		}
+	}
+
+private:
+	Hdf5File m_file;
+	std::vector<std::pair<std::string, hid_t> > m_datasets;
 };
 
+}  // namespace detail
+#endif
+
 class MatInputFile : public MatFile {
 public:
 	explicit MatInputFile(const std::string& fileName) :
 			MatFile(fileName.c_str(), "r") {}
 
-	void writeVariable(const MxVariable& variable) override = delete;
-	void deleteVariable(const std::string& vaiableName) override = delete;
+	template <typename MxArrayType>
+	void writeVariable(const MxArrayType& variable,
+					const std::string& variableName) = delete;
+	void writeVariable(const MxVariable& variable) = delete;
+	void deleteVariable(const std::string& vaiableName) = delete;
+
+#ifdef MAT_UTILS_USE_HDF5
+	/*
+	 * Reads the block of a numeric variable that starts at offsets and spans
+	 * counts elements along each dimension (zero-based, one entry per
+	 * dimension of the variable) into buffer, column-major, which must hold
+	 * the product of counts elements. The file must be a v7.3 MAT file, which
+	 * is HDF5: only the chunks that intersect the block are read and
+	 * decompressed, so memory use scales with the block rather than the
+	 * variable. NumericType must match the MATLAB class of the variable.
+	 * Complex and sparse variables are not supported. Needs
+	 * MAT_UTILS_USE_HDF5 (and linking with the libhdf5 that ships with
+	 * MATLAB).
+	 */
+	template <typename NumericType, typename IndexType>
+	inline void readVariableBlock(const std::string& variableName,
+								const std::vector<IndexType>& offsets,
+								const std::vector<IndexType>& counts,
+								NumericType* buffer) const {
+		const hid_t dataset = m_datasets.get(getFileName(), variableName);
+		mexAssertEx(detail::getHdf5MatlabClass(dataset)
+					== detail::getClassIdName(
+									MxNumericClass<NumericType>::m_classId),
+					"Variable class does not match");
+		mexAssertEx(H5Aexists(dataset, "MATLAB_empty") <= 0,
+					"Variable is empty");
+		const hid_t type = H5Dget_type(dataset);
+		const H5T_class_t typeClass = H5Tget_class(type);
+		H5Tclose(type);
+		mexAssertEx((typeClass == H5T_INTEGER) || (typeClass == H5T_FLOAT),
+					"Only real numeric variables can be read by block");
+
+		const hid_t fileSpace = H5Dget_space(dataset);
+		const size_t rank = static_cast<size_t>(
+										H5Sget_simple_extent_ndims(fileSpace));
+		mexAssertEx((offsets.size() == rank) && (counts.size() == rank),
+					"Block rank does not match variable");
+		/*
+		 * HDF5 is row-major, so MATLAB stores the dimensions reversed.
+		 */
+		std::vector<hsize_t> dims(rank);
+		std::vector<hsize_t> start(rank);
+		std::vector<hsize_t> count(rank);
+		H5Sget_simple_extent_dims(fileSpace, dims.data(), nullptr);
+		hsize_t numel = 1;
+		for (size_t iter = 0; iter < rank; ++iter) {
+			start[rank - 1 - iter] = static_cast<hsize_t>(offsets[iter]);
+			count[rank - 1 - iter] = static_cast<hsize_t>(counts[iter]);
+			numel *= count[rank - 1 - iter];
+		}
+		bool isInside = true;
+		for (size_t iter = 0; iter < rank; ++iter) {
+			isInside = isInside && (start[iter] <= dims[iter])
+						&& (count[iter] <= dims[iter] - start[iter]);
+		}
+		if (!isInside || (numel == 0)) {
+			H5Sclose(fileSpace);
+			mexAssertEx(isInside, "Block exceeds variable dimensions");
+			return;
+		}
+
+		H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start.data(), nullptr,
+							count.data(), nullptr);
+		const hid_t memorySpace = H5Screate_simple(static_cast<int>(rank),
+													count.data(), nullptr);
+		const herr_t status = H5Dread(dataset,
+									detail::Hdf5Type<NumericType>::get(),
+									memorySpace, fileSpace, H5P_DEFAULT,
+									static_cast<void*>(buffer));
+		H5Sclose(memorySpace);
+		H5Sclose(fileSpace);
+		mexAssert(status >= 0);
+	}
+
+	template <typename NumericType, typename IndexType>
+	inline void readVariableBlock(const std::string& variableName,
+								const std::vector<IndexType>& offsets,
+								const std::vector<IndexType>& counts,
+								MxNumeric<NumericType>& block) const {
+		size_t numel = 1;
+		for (size_t iter = 0, end = counts.size(); iter < end; ++iter) {
+			numel *= static_cast<size_t>(counts[iter]);
+		}
+		mexAssertEx(block.template getNumberOfElements<size_t>() == numel,
+					"Block size does not match");
+		readVariableBlock(variableName, offsets, counts, block.getData());
+	}
+
+	template <typename NumericType, typename IndexType>
+	inline MxNumeric<NumericType> readVariableBlock(
+										const std::string& variableName,
+										const std::vector<IndexType>& offsets,
+										const std::vector<IndexType>& counts)
+										const {
+		MxNumeric<NumericType> retArg(kUninitialized, counts);
+		readVariableBlock(variableName, offsets, counts, retArg.getData());
+		return retArg;
+	}
+#endif
 
 	virtual ~MatInputFile() = default;
+
+#ifdef MAT_UTILS_USE_HDF5
+private:
+	mutable detail::Hdf5DatasetCache m_datasets;
+#endif
+};
+
+#ifdef MAT_UTILS_USE_HDF5
+/*
+ * Numeric variable of a v7.3 MAT file written in slices along its last
+ * dimension, as they are produced, so that the whole variable never has to be
+ * in memory. Created by MatOutputFile::createVariableStream. Each append
+ * writes its slices straight to the HDF5 dataset of the variable; the chunk
+ * cache holds one row of chunks, so memory use is that of the appended data
+ * plus about one chunk per slice-sized block. The variable loads as a normal
+ * MATLAB array once the stream is closed.
+ */
+template <typename NumericType>
+class MatVariableStream {
+public:
+	MatVariableStream() :
+			m_dataset(-1),
+			m_hdf5Dims(),
+			m_sliceSize(0),
+			m_numSlices(0),
+			m_maxSlices(0) {}
+
+	/*
+	 * dims are the MATLAB dimensions of the finished variable, with the last
+	 * one 0 for a variable that grows with every append.
+	 */
+	MatVariableStream(const hid_t file, const std::string& variableName,
+					const std::vector<mwSize>& dims,
+					const int compressionLevel) :
+			m_dataset(-1),
+			m_hdf5Dims(dims.rbegin(), dims.rend()),
+			m_sliceSize(1),
+			m_numSlices(0),
+			m_maxSlices(dims.empty() ? 0 : dims.back()) {
+		mexAssertEx(dims.size() >= 2, "Variables have at least two dimensions");
+		const int rank = static_cast<int>(dims.size());
+		for (int iter = 1; iter < rank; ++iter) {
+			m_sliceSize *= m_hdf5Dims[iter];
+		}
+		mexAssertEx(m_sliceSize > 0, "Slices must not be empty");
+		std::vector<hsize_t> maxDims(m_hdf5Dims);
+		if (m_maxSlices == 0) {
+			maxDims[0] = H5S_UNLIMITED;
+		}
+		const std::vector<hsize_t> chunkDims = detail::getHdf5ChunkDims(
+													m_hdf5Dims,
+													sizeof(NumericType));
+		hsize_t numChunksPerRow = 1;
+		for (int iter = 1; iter < rank; ++iter) {
+			numChunksPerRow *= (m_hdf5Dims[iter] + chunkDims[iter] - 1)
+								/ chunkDims[iter];
+		}
+		hsize_t chunkBytes = sizeof(NumericType);
+		for (int iter = 0; iter < rank; ++iter) {
+			chunkBytes *= chunkDims[iter];
+		}
+
+		const hid_t createProperties = H5Pcreate(H5P_DATASET_CREATE);
+		H5Pset_chunk(createProperties, rank, chunkDims.data());
+		if (compressionLevel > 0) {
+			H5Pset_deflate(createProperties,
+						static_cast<unsigned>(compressionLevel));
+		}
+		const hid_t accessProperties = H5Pcreate(H5P_DATASET_ACCESS);
+		H5Pset_chunk_cache(accessProperties, detail::kHdf5ChunkCacheSlots,
+						static_cast<size_t>(numChunksPerRow * chunkBytes), 1.0);
+		const hid_t space = H5Screate_simple(rank, m_hdf5Dims.data(),
+											maxDims.data());
+		m_dataset = H5Dcreate2(file, variableName.c_str(),
+							detail::Hdf5Type<NumericType>::get(), space,
+							H5P_DEFAULT, createProperties, accessProperties);
+		H5Sclose(space);
+		H5Pclose(accessProperties);
+		H5Pclose(createProperties);
+		mexAssertEx(m_dataset >= 0, "Cannot create variable");
+		detail::setHdf5MatlabClass(m_dataset, detail::getClassIdName(
+									MxNumericClass<NumericType>::m_classId));
+	}
+
+	MatVariableStream(const MatVariableStream<NumericType>& other) = delete;
+	MatVariableStream<NumericType>& operator=(
+							const MatVariableStream<NumericType>& other) = delete;
+
+	MatVariableStream(MatVariableStream<NumericType>&& other) :
+			m_dataset(other.m_dataset),
+			m_hdf5Dims(std::move(other.m_hdf5Dims)),
+			m_sliceSize(other.m_sliceSize),
+			m_numSlices(other.m_numSlices),
+			m_maxSlices(other.m_maxSlices) {
+		other.m_dataset = -1;
+	}
+
+	MatVariableStream<NumericType>& operator=(
+									MatVariableStream<NumericType>&& other) {
+		if (this != &other) {
+			close();
+			m_dataset = other.m_dataset;
+			m_hdf5Dims = std::move(other.m_hdf5Dims);
+			m_sliceSize = other.m_sliceSize;
+			m_numSlices = other.m_numSlices;
+			m_maxSlices = other.m_maxSlices;
+			other.m_dataset = -1;
+		}
+		return *this;
+	}
+
+	/*
+	 * Writes numSlices slices, each holding the product of all but the last
+	 * dimension elements, column-major.
+	 */
+	inline void append(const NumericType* data, const mwSize numSlices) {
+		mexAssertEx(m_dataset >= 0, "Stream is closed");
+		const hsize_t numSlicesAfter = m_numSlices
+										+ static_cast<hsize_t>(numSlices);
+		mexAssertEx((m_maxSlices == 0) || (numSlicesAfter <= m_maxSlices),
+					"More slices than the variable holds");
+		if (numSlices == 0) {
+			return;
+		}
+		if (m_maxSlices == 0) {
+			m_hdf5Dims[0] = numSlicesAfter;
+			H5Dset_extent(m_dataset, m_hdf5Dims.data());
+		}
+		const int rank = static_cast<int>(m_hdf5Dims.size());
+		std::vector<hsize_t> start(m_hdf5Dims.size(), 0);
+		std::vector<hsize_t> count(m_hdf5Dims);
+		start[0] = m_numSlices;
+		count[0] = static_cast<hsize_t>(numSlices);
+		const hid_t fileSpace = H5Dget_space(m_dataset);
+		H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start.data(), nullptr,
+							count.data(), nullptr);
+		const hid_t memorySpace = H5Screate_simple(rank, count.data(), nullptr);
+		const herr_t status = H5Dwrite(m_dataset,
+									detail::Hdf5Type<NumericType>::get(),
+									memorySpace, fileSpace, H5P_DEFAULT,
+									static_cast<const void*>(data));
+		H5Sclose(memorySpace);
+		H5Sclose(fileSpace);
+		mexAssert(status >= 0);
+		m_numSlices = numSlicesAfter;
+	}
+
+	/*
+	 * Writes the slices of chunk, whose leading dimensions are those of the
+	 * variable.
+	 */
+	inline void append(const MxNumeric<NumericType>& chunk) {
+		const hsize_t numel = chunk.template getNumberOfElements<hsize_t>();
+		mexAssertEx(numel % m_sliceSize == 0,
+					"Chunk is not a whole number of slices");
+		append(chunk.getData(), static_cast<mwSize>(numel / m_sliceSize));
+	}
+
+	inline mwSize getNumberOfSlices() const {
+		return static_cast<mwSize>(m_numSlices);
+	}
+
+	inline bool isOpen() const {
+		return (m_dataset >= 0);
+	}
+
+	/*
+	 * Flushes the dataset. A variable of fixed dimensions must have all its
+	 * slices written by then.
+	 */
+	inline void close() {
+		if (m_dataset >= 0) {
+			const bool isComplete = ((m_maxSlices == 0)
+									|| (m_numSlices == m_maxSlices));
+			H5Dclose(m_dataset);
+			m_dataset = -1;
+			mexAssertEx(isComplete, "Stream closed before all slices were "
+						"written");
+		}
+	}
+
+	~MatVariableStream() {
+		if (m_dataset >= 0) {
+			H5Dclose(m_dataset);
+		}
+	}
+
+private:
+	hid_t m_dataset;
+	std::vector<hsize_t> m_hdf5Dims;
+	hsize_t m_sliceSize;
+	hsize_t m_numSlices;
+	hsize_t m_maxSlices;
 };
+#endif
 
-class MatOutputFile : MatFile {
+class MatOutputFile : public MatFile {
 public:
 	explicit MatOutputFile(const std::string& fileName) :
 			MatFile(fileName.c_str(), "w7.3") {}
 
-	bool hasVariable(const std::string& variableName) const override = delete;
-	std::vector<std::string> getVariableNames() const override = delete;
-	MxArrayHeader getVariableInfo(const std::string& variableName) const override = delete;
-	MxVariableHeader getNextVariableInfo() const override = delete;
+	bool hasVariable(const std::string& variableName) const = delete;
+	std::vector<std::string> getVariableNames() const = delete;
+	MxArrayHeader getVariableInfo(const std::string& variableName) const = delete;
+	MxVariableHeader getNextVariableInfo() const = delete;
 
 
 	template <typename MxArrayType>
-	MxArrayType readVariable(const std::string& variableName) const override = delete;
-	MxArray readVariable(const std::string& variableName) const override = delete;
+	MxArrayType readVariable(const std::string& variableName) const = delete;
+	MxArray readVariable(const std::string& variableName) const = delete;
 
 	template <typename MxArrayType>
-	MxVariable readNextVariable() override = delete;
+	MxVariable readNextVariable() = delete;
+
+#ifdef MAT_UTILS_USE_HDF5
+	/*
+	 * Starts a numeric variable with final dimensions dims, to be written in
+	 * slices along the last dimension through the returned stream. If the
+	 * last dimension is 0, the variable grows with every append instead.
+	 * compressionLevel is that of deflate, 0 to store. The stream writes
+	 * through HDF5 to the same file as the MAT-file API, so it needs
+	 * MAT_UTILS_USE_HDF5 and the libhdf5 that ships with MATLAB; it must be
+	 * closed before the file is.
+	 */
+	template <typename NumericType, typename IndexType>
+	inline MatVariableStream<NumericType> createVariableStream(
+										const std::string& variableName,
+										const std::vector<IndexType>& dims,
+										const int compressionLevel = 0) {
+		return MatVariableStream<NumericType>(
+									m_hdf5File.get(getFileName(), H5F_ACC_RDWR),
+									variableName,
+									std::vector<mwSize>(dims.begin(), dims.end()),
+									compressionLevel);
+	}
+#endif
 
 	virtual ~MatOutputFile() = default;
+
+#ifdef MAT_UTILS_USE_HDF5
+private:
+	detail::Hdf5File m_hdf5File;
+#endif
+};
+
+namespace detail {
+
+/*
+ * Data types of the elements of a MAT v5 file.
+ */
+const std::uint32_t kMiInt8 = 1;
+const std::uint32_t kMiUint8 = 2;
+const std::uint32_t kMiInt16 = 3;
+const std::uint32_t kMiUint16 = 4;
+const std::uint32_t kMiInt32 = 5;
+const std::uint32_t kMiUint32 = 6;
+const std::uint32_t kMiSingle = 7;
+const std::uint32_t kMiDouble = 9;
+const std::uint32_t kMiInt64 = 12;
+const std::uint32_t kMiUint64 = 13;
+const std::uint32_t kMiMatrix = 14;
+const std::uint32_t kMiCompressed = 15;
+
+const size_t kMatHeaderSize = 128;
+const size_t kMatTagSize = 8;
+
+/*
+ * Array flags of a miMATRIX element. The class is stored in the low byte, with
+ * the file's own numbering for the classes that mxClassID does not share.
+ */
+const std::uint32_t kMatClassMask = 0xFF;
+const std::uint32_t kMatFlagLogical = 0x0200;
+const std::uint32_t kMatFlagComplex = 0x0800;
+const std::uint32_t kMatObjectClass = 3;
+const std::uint32_t kMatSparseClass = 5;
+
+inline size_t getMatDataTypeSize(const std::uint32_t dataType) {
+	switch (dataType) {
+		case kMiInt8:
+		case kMiUint8: {
+			return 1;
+		}
+		case kMiInt16:
+		case kMiUint16: {
+			return 2;
+		}
+		case kMiInt32:
+		case kMiUint32:
+		case kMiSingle: {
+			return 4;
+		}
+		case kMiDouble:
+		case kMiInt64:
+		case kMiUint64: {
+			return 8;
+		}
+		default: {
+			return 0;
+		}
+	}
+}
+
+/*
+ * Sequential reader over bytes already in memory, such as an uncompressed
+ * element of a mapped file.
+ */
+class MatMemoryStream {
+public:
+	MatMemoryStream(const char* begin, const char* end) :
+			m_position(begin),
+			m_end(end) {}
+
+	inline bool read(void* destination, const size_t numBytes) {
+		if (numBytes > static_cast<size_t>(m_end - m_position)) {
+			return false;
+		}
+		std::memcpy(destination, static_cast<const void*>(m_position),
+					numBytes);
+		m_position += numBytes;
+		return true;
+	}
+
+	inline bool skip(const size_t numBytes) {
+		if (numBytes > static_cast<size_t>(m_end - m_position)) {
+			return false;
+		}
+		m_position += numBytes;
+		return true;
+	}
+
+	inline const char* get_position() const {
+		return m_position;
+	}
+
+private:
+	const char* m_position;
+	const char* m_end;
+};
+
+/*
+ * Sequential reader over the inflated contents of a miCOMPRESSED element.
+ * Only as much of the element is inflated as is read or skipped.
+ */
+class MatInflateStream {
+public:
+	MatInflateStream(const char* begin, const char* end) :
+			m_stream() {
+		m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(begin));
+		m_stream.avail_in = static_cast<uInt>(end - begin);
+		m_isValid = (inflateInit(&m_stream) == Z_OK);
+	}
+
+	MatInflateStream(const MatInflateStream& other) = delete;
+	MatInflateStream& operator=(const MatInflateStream& other) = delete;
+
+	inline bool read(void* destination, size_t numBytes) {
+		m_stream.next_out = static_cast<Bytef*>(destination);
+		while (m_isValid && (numBytes > 0)) {
+			const uInt chunkBytes = static_cast<uInt>(
+								std::min(numBytes, static_cast<size_t>(UINT_MAX)));
+			m_stream.avail_out = chunkBytes;
+			const int status = inflate(&m_stream, Z_NO_FLUSH);
+			const size_t numProduced = chunkBytes - m_stream.avail_out;
+			numBytes -= numProduced;
+			if ((status != Z_OK) && ((status != Z_STREAM_END) || (numBytes > 0))) {
+				m_isValid = false;
+			} else if ((numProduced == 0) && (numBytes > 0)) {
+				m_isValid = false;
+			}
+		}
+		m_stream.next_out = nullptr;
+		return m_isValid;
+	}
+
+	inline bool skip(size_t numBytes) {
+		char buffer[4096];
+		while (numBytes > 0) {
+			const size_t chunkBytes = std::min(numBytes, sizeof(buffer));
+			if (!read(buffer, chunkBytes)) {
+				return false;
+			}
+			numBytes -= chunkBytes;
+		}
+		return true;
+	}
+
+	~MatInflateStream() {
+		inflateEnd(&m_stream);
+	}
+
+private:
+	z_stream m_stream;
+	bool m_isValid;
+};
+
+/*
+ * Element tag. Elements of up to four bytes may use the small format, where
+ * the data is stored in the second word of the tag itself.
+ */
+struct MatElementTag {
+	std::uint32_t m_dataType;
+	std::uint32_t m_numBytes;
+	bool m_isSmall;
+	char m_smallData[4];
+};
+
+template <typename Stream>
+inline bool readMatTag(Stream& stream, MatElementTag& tag) {
+	std::uint32_t words[2];
+	if (!stream.read(words, sizeof(words))) {
+		return false;
+	}
+	tag.m_isSmall = ((words[0] >> 16) != 0);
+	if (tag.m_isSmall) {
+		tag.m_dataType = words[0] & 0xFFFF;
+		tag.m_numBytes = words[0] >> 16;
+		std::memcpy(tag.m_smallData, &words[1], sizeof(tag.m_smallData));
+		return (tag.m_numBytes <= sizeof(tag.m_smallData));
+	}
+	tag.m_dataType = words[0];
+	tag.m_numBytes = words[1];
+	return true;
+}
+
+inline size_t getMatPadding(const size_t numBytes) {
+	return (kMatTagSize - numBytes % kMatTagSize) % kMatTagSize;
+}
+
+/*
+ * Reads the m_numBytes of data of an element into destination, and skips the
+ * padding that follows it.
+ */
+template <typename Stream>
+inline bool readMatElementData(Stream& stream, const MatElementTag& tag,
+							void* destination) {
+	if (tag.m_isSmall) {
+		std::memcpy(destination, tag.m_smallData, tag.m_numBytes);
+		return true;
+	}
+	return (stream.read(destination, tag.m_numBytes)
+			&& stream.skip(getMatPadding(tag.m_numBytes)));
+}
+
+template <typename StorageType, typename NumericType, typename Stream>
+inline bool readMatConverted(Stream& stream, NumericType* destination,
+							const size_t numel) {
+	if (std::is_same<StorageType, NumericType>::value) {
+		return stream.read(destination, numel * sizeof(NumericType));
+	}
+	const size_t kBlockSize = 1024;
+	StorageType buffer[kBlockSize];
+	for (size_t iter = 0; iter < numel; iter += kBlockSize) {
+		const size_t blockSize = std::min(kBlockSize, numel - iter);
+		if (!stream.read(buffer, blockSize * sizeof(StorageType))) {
+			return false;
+		}
+		for (size_t iterBlock = 0; iterBlock < blockSize; ++iterBlock) {
+			destination[iter + iterBlock] =
+									static_cast<NumericType>(buffer[iterBlock]);
+		}
+	}
+	return true;
+}
+
+/*
+ * Reads numel elements stored as dataType into destination, converting them
+ * to NumericType. MATLAB stores numeric data in the smallest type that holds
+ * it exactly, so a double array may be stored, for example, as miUINT8.
+ */
+template <typename NumericType, typename Stream>
+inline bool readMatNumeric(Stream& stream, const std::uint32_t dataType,
+						NumericType* destination, const size_t numel) {
+	switch (dataType) {
+		case kMiInt8: {
+			return readMatConverted<INT8_T>(stream, destination, numel);
+		}
+		case kMiUint8: {
+			return readMatConverted<UINT8_T>(stream, destination, numel);
+		}
+		case kMiInt16: {
+			return readMatConverted<INT16_T>(stream, destination, numel);
+		}
+		case kMiUint16: {
+			return readMatConverted<UINT16_T>(stream, destination, numel);
+		}
+		case kMiInt32: {
+			return readMatConverted<INT32_T>(stream, destination, numel);
+		}
+		case kMiUint32: {
+			return readMatConverted<UINT32_T>(stream, destination, numel);
+		}
+		case kMiInt64: {
+			return readMatConverted<INT64_T>(stream, destination, numel);
+		}
+		case kMiUint64: {
+			return readMatConverted<UINT64_T>(stream, destination, numel);
+		}
+		case kMiSingle: {
+			return readMatConverted<float>(stream, destination, numel);
+		}
+		case kMiDouble: {
+			return readMatConverted<double>(stream, destination, numel);
+		}
+		default: {
+			return false;
+		}
+	}
+}
+
+/*
+ * Logical arrays are always stored as miUINT8.
+ */
+template <typename Stream>
+inline bool readMatNumeric(Stream& stream, const std::uint32_t dataType,
+						bool* destination, const size_t numel) {
+	return ((dataType == kMiUint8)
+			&& readMatConverted<UINT8_T>(stream, destination, numel));
+}
+
+/*
+ * Reads the data element of the real part of a numeric array into
+ * destination, which holds numel elements.
+ */
+template <typename NumericType, typename Stream>
+inline bool readMatNumericElement(Stream& stream, NumericType* destination,
+								const size_t numel) {
+	MatElementTag tag;
+	if (!readMatTag(stream, tag)
+		|| (tag.m_numBytes != numel * getMatDataTypeSize(tag.m_dataType))) {
+		return false;
+	}
+	if (tag.m_isSmall) {
+		MatMemoryStream smallStream(tag.m_smallData,
+									tag.m_smallData + tag.m_numBytes);
+		return readMatNumeric(smallStream, tag.m_dataType, destination, numel);
+	}
+	return (readMatNumeric(stream, tag.m_dataType, destination, numel)
+			&& stream.skip(getMatPadding(tag.m_numBytes)));
+}
+
+/*
+ * Data type in which the data of a class is stored without conversion.
+ */
+inline std::uint32_t getMatDataType(const mxClassID classId) {
+	switch (classId) {
+		case mxLOGICAL_CLASS:
+		case mxUINT8_CLASS: {
+			return kMiUint8;
+		}
+		case mxDOUBLE_CLASS: {
+			return kMiDouble;
+		}
+		case mxSINGLE_CLASS: {
+			return kMiSingle;
+		}
+		case mxINT8_CLASS: {
+			return kMiInt8;
+		}
+		case mxINT16_CLASS: {
+			return kMiInt16;
+		}
+		case mxUINT16_CLASS: {
+			return kMiUint16;
+		}
+		case mxINT32_CLASS: {
+			return kMiInt32;
+		}
+		case mxUINT32_CLASS: {
+			return kMiUint32;
+		}
+		case mxINT64_CLASS: {
+			return kMiInt64;
+		}
+		case mxUINT64_CLASS: {
+			return kMiUint64;
+		}
+		default: {
+			return 0;
+		}
+	}
+}
+
+inline mxClassID getMatClass(const std::uint32_t flags) {
+	const std::uint32_t fileClass = flags & kMatClassMask;
+	if ((flags & kMatFlagLogical) != 0) {
+		return mxLOGICAL_CLASS;
+	} else if (fileClass == kMatSparseClass) {
+		return mxDOUBLE_CLASS;
+	} else if (fileClass == kMatObjectClass) {
+		return mxOBJECT_CLASS;
+	} else if (fileClass <= static_cast<std::uint32_t>(mxOPAQUE_CLASS)) {
+		return static_cast<mxClassID>(fileClass);
+	}
+	return mxUNKNOWN_CLASS;
+}
+
+}  // namespace detail
+
+/*
+ * Header of a variable of a MAT v5 file, as found by MatMappedFile without
+ * decoding the variable. m_offset and m_size locate the whole element,
+ * including its tag. For uncompressed numeric variables, m_dataOffset is the
+ * file offset of the real part and m_dataType its storage type; both are zero
+ * otherwise.
+ */
+struct MatVariableInfo {
+	std::string m_name;
+	mxClassID m_class;
+	std::vector<mwSize> m_dimensions;
+	bool m_isComplex;
+	bool m_isSparse;
+	bool m_isCompressed;
+	std::uint32_t m_dataType;
+	size_t m_offset;
+	size_t m_size;
+	size_t m_dataOffset;
+
+	inline size_t getNumberOfElements() const {
+		size_t numel = 1;
+		for (size_t iter = 0, end = m_dimensions.size(); iter < end; ++iter) {
+			numel *= m_dimensions[iter];
+		}
+		return numel;
+	}
+
+	inline bool isNumeric() const {
+		return (((m_class >= mxDOUBLE_CLASS) && (m_class <= mxUINT64_CLASS))
+				|| (m_class == mxLOGICAL_CLASS)) && !m_isSparse;
+	}
+};
+
+namespace detail {
+
+/*
+ * Parses the array flags, dimensions and name of a miMATRIX element, whose
+ * tag has already been read. The stream is left at the real part.
+ */
+template <typename Stream>
+inline bool readMatArrayHeader(Stream& stream, MatVariableInfo& info) {
+	MatElementTag tag;
+	std::uint32_t flags[2];
+	if (!readMatTag(stream, tag) || (tag.m_dataType != kMiUint32)
+		|| (tag.m_numBytes != sizeof(flags))
+		|| !readMatElementData(stream, tag, flags)) {
+		return false;
+	}
+	info.m_class = getMatClass(flags[0]);
+	info.m_isComplex = ((flags[0] & kMatFlagComplex) != 0);
+	info.m_isSparse = ((flags[0] & kMatClassMask) == kMatSparseClass);
+
+	if (!readMatTag(stream, tag) || (tag.m_dataType != kMiInt32)) {
+		return false;
+	}
+	std::vector<INT32_T> dims(tag.m_numBytes / sizeof(INT32_T));
+	if (!readMatElementData(stream, tag, dims.data())
+		|| (std::find_if(dims.begin(), dims.end(),
+						[](const INT32_T dim) { return dim < 0; })
+			!= dims.end())) {
+		return false;
+	}
+	info.m_dimensions.assign(dims.begin(), dims.end());
+
+	if (!readMatTag(stream, tag) || (tag.m_dataType != kMiInt8)) {
+		return false;
+	}
+	info.m_name.resize(tag.m_numBytes);
+	if (!readMatElementData(stream, tag, &info.m_name[0])) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Reads the tag of the real part of a numeric array, and records its storage
+ * type in info if it is consistent with the dimensions. The stream is left at
+ * the start of the data.
+ */
+template <typename Stream>
+inline bool readMatDataTag(Stream& stream, MatVariableInfo& info) {
+	MatElementTag tag;
+	if (!readMatTag(stream, tag) || tag.m_isSmall
+		|| (tag.m_numBytes != info.getNumberOfElements()
+							* getMatDataTypeSize(tag.m_dataType))) {
+		return false;
+	}
+	info.m_dataType = tag.m_dataType;
+	return true;
+}
+
+}  // namespace detail
+
+/*
+ * Read-only view of a MAT v5 (or v7, i.e. v5 with compression) file through a
+ * memory mapping. Opening the file scans only the element tags and variable
+ * headers, inflating just the headers of compressed variables, so it takes
+ * time proportional to the number of variables rather than their size.
+ *
+ * getView returns a zero-copy view into the mapped pages of an uncompressed,
+ * real numeric variable stored in its own class (see isMappable); pages are
+ * read from disk only as the view touches them, and the view is valid while
+ * the MatMappedFile is alive. readNumeric decodes any real numeric variable,
+ * compressed or not, into a new MxNumeric, converting from the storage type.
+ * Other variables (cells, structs, strings, sparse and complex arrays) are
+ * read through the MAT-file API by readVariable.
+ *
+ * Only files in the byte order of the machine are supported, and v7.3 files,
+ * which are HDF5, are rejected. Compressed variables are inflated with zlib
+ * (link with -lz).
+ */
+class MatMappedFile {
+public:
+	explicit MatMappedFile(const std::string& fileName) :
+			m_fileName(fileName),
+			m_data(nullptr),
+			m_size(0) {
+		const int fileDescriptor = open(fileName.c_str(), O_RDONLY);
+		if (fileDescriptor < 0) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Cannot open MAT file %s.\n",
+							fileName.c_str());
+			return;
+		}
+		struct stat fileStatus;
+		const bool isStated = (fstat(fileDescriptor, &fileStatus) == 0);
+		m_size = isStated ? static_cast<size_t>(fileStatus.st_size) : 0;
+		if (m_size >= detail::kMatHeaderSize) {
+			void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE,
+							fileDescriptor, 0);
+			m_data = (data != MAP_FAILED) ? static_cast<const char*>(data)
+											: nullptr;
+		}
+		close(fileDescriptor);
+		if (m_data == nullptr) {
+			m_size = 0;
+			mexErrMsgIdAndTxt("MATLAB:mex", "Cannot map MAT file %s.\n",
+							fileName.c_str());
+			return;
+		}
+		if (!isNativeVersion5()) {
+			munmap(const_cast<char*>(m_data), m_size);
+			m_data = nullptr;
+			m_size = 0;
+			mexErrMsgIdAndTxt("MATLAB:mex", "%s is not a MAT v5 file in native "
+							"byte order; v7.3 files are read by MatInputFile.\n",
+							fileName.c_str());
+			return;
+		}
+		scan();
+	}
+
+	MatMappedFile(const MatMappedFile& other) = delete;
+	MatMappedFile& operator=(const MatMappedFile& other) = delete;
+	MatMappedFile(MatMappedFile&& other) = delete;
+	MatMappedFile& operator=(MatMappedFile&& other) = delete;
+
+	inline const std::string& getFileName() const {
+		return m_fileName;
+	}
+
+	inline bool hasVariable(const std::string& variableName) const {
+		return (m_index.find(variableName) != m_index.end());
+	}
+
+	inline std::vector<std::string> getVariableNames() const {
+		std::vector<std::string> retArg;
+		retArg.reserve(m_variables.size());
+		for (size_t iter = 0, end = m_variables.size(); iter < end; ++iter) {
+			retArg.push_back(m_variables[iter].m_name);
+		}
+		return retArg;
+	}
+
+	inline const MatVariableInfo& getVariableInfo(
+									const std::string& variableName) const {
+		const std::unordered_map<std::string, size_t>::const_iterator
+											position = m_index.find(variableName);
+		if (position == m_index.end()) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "No variable %s in MAT file %s.\n",
+							variableName.c_str(), m_fileName.c_str());
+		}
+		return m_variables[position->second];
+	}
+
+	inline const std::vector<MatVariableInfo>& getVariables() const {
+		return m_variables;
+	}
+
+	/*
+	 * Whether getView can be used for the variable.
+	 */
+	inline bool isMappable(const std::string& variableName) const {
+		const MatVariableInfo& info = getVariableInfo(variableName);
+		return (!info.m_isCompressed && info.isNumeric() && !info.m_isComplex
+				&& (info.m_dataOffset != 0)
+				&& (info.m_dataType == detail::getMatDataType(info.m_class)));
+	}
+
+	template <typename NumericType>
+	inline MxNumericView<const NumericType> getView(
+									const std::string& variableName) const {
+		const MatVariableInfo& info = getVariableInfo(variableName);
+		if (info.m_class != MxNumericClass<NumericType>::m_classId) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Variable %s is of class %s.\n",
+							variableName.c_str(),
+							detail::getClassIdName(info.m_class).c_str());
+		}
+		if (!isMappable(variableName)) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Variable %s is compressed, "
+							"complex, or not stored in its own class; use "
+							"readNumeric.\n", variableName.c_str());
+		}
+		const char* data = m_data + info.m_dataOffset;
+		mexAssert(reinterpret_cast<std::uintptr_t>(data) % alignof(NumericType)
+				== 0);
+		std::vector<mwSize> strides(info.m_dimensions.size());
+		mwSize stride = 1;
+		for (size_t iter = 0, end = strides.size(); iter < end; ++iter) {
+			strides[iter] = stride;
+			stride *= info.m_dimensions[iter];
+		}
+		return MxNumericView<const NumericType>(
+								reinterpret_cast<const NumericType*>(data),
+								info.m_dimensions, strides);
+	}
+
+	template <typename NumericType>
+	inline MxNumeric<NumericType> readNumeric(
+									const std::string& variableName) const {
+		const MatVariableInfo& info = getVariableInfo(variableName);
+		if (!info.isNumeric() || info.m_isComplex) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Variable %s is not a real numeric "
+							"array; use readVariable.\n", variableName.c_str());
+		}
+		if (info.m_class != MxNumericClass<NumericType>::m_classId) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Variable %s is of class %s.\n",
+							variableName.c_str(),
+							detail::getClassIdName(info.m_class).c_str());
+		}
+		MxNumeric<NumericType> retArg(kUninitialized, info.m_dimensions);
+		/*
+		 * MATLAB frees retArg when the error aborts the MEX function.
+		 */
+		if (!readNumeric(info, retArg.getData())) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Variable %s of MAT file %s is "
+							"corrupt.\n", variableName.c_str(),
+							m_fileName.c_str());
+		}
+		return retArg;
+	}
+
+	/*
+	 * Decodes the real numeric variable of info, which must be of this file,
+	 * into destination, which holds info.getNumberOfElements() elements.
+	 * Makes no MATLAB API calls, so it may run on any thread. Returns false if
+	 * the variable is corrupt.
+	 */
+	template <typename NumericType>
+	inline bool readNumeric(const MatVariableInfo& info,
+							NumericType* destination) const {
+		const char* begin = m_data + info.m_offset + detail::kMatTagSize;
+		const char* end = m_data + info.m_offset + info.m_size;
+		if (info.m_isCompressed) {
+			detail::MatInflateStream stream(begin, end);
+			detail::MatElementTag tag;
+			return (detail::readMatTag(stream, tag)
+					&& (tag.m_dataType == detail::kMiMatrix)
+					&& readNumericData(stream, info, destination));
+		}
+		detail::MatMemoryStream stream(begin, end);
+		return readNumericData(stream, info, destination);
+	}
+
+	/*
+	 * Reads any variable through the MAT-file API.
+	 */
+	inline MxArray readVariable(const std::string& variableName) const {
+		MATFile* file = matOpen(m_fileName.c_str(), "r");
+		mexAssert(file != nullptr);
+		mxArray* variable = matGetVariable(file, variableName.c_str());
+		matClose(file);
+		mexAssert(variable != nullptr);
+		return MxArray(variable);
+	}
+
+	~MatMappedFile() {
+		if (m_data != nullptr) {
+			munmap(const_cast<char*>(m_data), m_size);
+		}
+	}
+
+private:
+	/*
+	 * Decodes the real part of a numeric miMATRIX element, from just after its
+	 * tag.
+	 */
+	template <typename Stream, typename NumericType>
+	static inline bool readNumericData(Stream& stream,
+									const MatVariableInfo& info,
+									NumericType* destination) {
+		MatVariableInfo header;
+		return (detail::readMatArrayHeader(stream, header)
+				&& (header.m_dimensions == info.m_dimensions)
+				&& detail::readMatNumericElement(stream, destination,
+												info.getNumberOfElements()));
+	}
+
+	inline bool isNativeVersion5() const {
+		std::uint16_t version;
+		std::memcpy(&version, m_data + detail::kMatHeaderSize - 4,
+					sizeof(version));
+		return ((std::memcmp(m_data + detail::kMatHeaderSize - 2, "IM", 2) == 0)
+				&& (version == 0x0100));
+	}
+
+	/*
+	 * Walks the top-level elements, recording the header of every variable.
+	 * Elements that are not variables, such as the subsystem data, are
+	 * skipped. The walk stops at the first element that is malformed or
+	 * extends past the end of the file, so that the variables before a
+	 * truncated or corrupt one remain readable.
+	 */
+	inline void scan() {
+		size_t offset = detail::kMatHeaderSize;
+		while (m_size - offset >= detail::kMatTagSize) {
+			detail::MatMemoryStream stream(m_data + offset, m_data + m_size);
+			detail::MatElementTag tag;
+			if (!detail::readMatTag(stream, tag) || tag.m_isSmall) {
+				break;
+			}
+			size_t elementSize = detail::kMatTagSize + tag.m_numBytes;
+			if (tag.m_dataType != detail::kMiCompressed) {
+				elementSize += detail::getMatPadding(tag.m_numBytes);
+			}
+			if (elementSize > m_size - offset) {
+				break;
+			}
+			MatVariableInfo info;
+			info.m_isCompressed = (tag.m_dataType == detail::kMiCompressed);
+			info.m_dataType = 0;
+			info.m_offset = offset;
+			info.m_size = elementSize;
+			info.m_dataOffset = 0;
+			const char* begin = stream.get_position();
+			const char* end = m_data + offset + elementSize;
+			bool isParsed = false;
+			if (tag.m_dataType == detail::kMiMatrix) {
+				detail::MatMemoryStream elementStream(begin, end);
+				isParsed = detail::readMatArrayHeader(elementStream, info);
+				if (isParsed && info.isNumeric()
+					&& detail::readMatDataTag(elementStream, info)) {
+					info.m_dataOffset = static_cast<size_t>(
+										elementStream.get_position() - m_data);
+				}
+			} else if (info.m_isCompressed) {
+				detail::MatInflateStream elementStream(begin, end);
+				detail::MatElementTag matrixTag;
+				isParsed = (detail::readMatTag(elementStream, matrixTag)
+							&& (matrixTag.m_dataType == detail::kMiMatrix)
+							&& detail::readMatArrayHeader(elementStream, info));
+				if (isParsed && info.isNumeric()) {
+					detail::readMatDataTag(elementStream, info);
+				}
+			}
+			if (isParsed) {
+				m_index.emplace(info.m_name, m_variables.size());
+				m_variables.push_back(std::move(info));
+			}
+			offset += elementSize;
+		}
+	}
+
+	const std::string m_fileName;
+	const char* m_data;
+	size_t m_size;
+	std::vector<MatVariableInfo> m_variables;
+	std::unordered_map<std::string, size_t> m_index;
+};
+
+/*
+ * One variable to load with loadVariables or loadNumericVariables.
+ */
+struct MatLoadRequest {
+	std::string m_fileName;
+	std::string m_variableName;
+};
+
+namespace detail {
+
+template <typename NumericType>
+inline bool decodeMatVariable(const MatMappedFile& file,
+							const MatVariableInfo& info, void* data) {
+	return file.readNumeric(info, static_cast<NumericType*>(data));
+}
+
+/*
+ * Variable to decode natively into the data of an array that is already
+ * allocated.
+ */
+struct MatDecodeJob {
+	const MatMappedFile* m_file;
+	const MatVariableInfo* m_info;
+	void* m_data;
+	bool (*m_decode)(const MatMappedFile&, const MatVariableInfo&, void*);
+};
+
+struct MatDecodeJobBinder {
+	template <typename NumericType>
+	inline void operator()(MxNumeric<NumericType>& array) const {
+		m_job.m_data = array.getData();
+		m_job.m_decode = &decodeMatVariable<NumericType>;
+	}
+
+	MatDecodeJob& m_job;
+};
+
+/*
+ * Files of a batch, each opened once. v5 files are mapped, so that their
+ * numeric variables can be decoded natively; all others are read through the
+ * MAT-file API. Used on the calling thread only.
+ */
+class MatBatchFiles {
+public:
+	inline const MatMappedFile* getMappedFile(const std::string& fileName) {
+		const std::unordered_map<std::string,
+							std::unique_ptr<MatMappedFile> >::const_iterator
+								position = m_mappedFiles.find(fileName);
+		if (position != m_mappedFiles.end()) {
+			return position->second.get();
+		}
+		MatMappedFile* file = (getMatFileVersion(fileName) == 0x0100)
+							? new MatMappedFile(fileName) : nullptr;
+		m_mappedFiles.emplace(fileName, std::unique_ptr<MatMappedFile>(file));
+		return file;
+	}
+
+	inline MxArray readVariable(const std::string& fileName,
+								const std::string& variableName) {
+		std::unique_ptr<MatInputFile>& file = m_inputFiles[fileName];
+		if (!file) {
+			file.reset(new MatInputFile(fileName));
+		}
+		return file->readVariable(variableName);
+	}
+
+private:
+	std::unordered_map<std::string, std::unique_ptr<MatMappedFile> >
+																m_mappedFiles;
+	std::unordered_map<std::string, std::unique_ptr<MatInputFile> >
+																m_inputFiles;
+};
+
+inline bool isNativelyDecodable(const MatMappedFile* file,
+								const MatVariableInfo* info) {
+	return (file != nullptr) && info->isNumeric() && !info->m_isComplex;
+}
+
+/*
+ * Runs the jobs on the OpenMP thread team, largest first so that the last
+ * ones to finish are short. Errors cannot be raised from the team, so a
+ * variable that fails to decode is reported once all jobs are done.
+ */
+inline void runMatDecodeJobs(std::vector<MatDecodeJob>& jobs) {
+	std::sort(jobs.begin(), jobs.end(),
+			[](const MatDecodeJob& first, const MatDecodeJob& second) {
+				return (first.m_info->m_size > second.m_info->m_size);
+			});
+	const int numJobs = static_cast<int>(jobs.size());
+	std::vector<char> isDecoded(jobs.size(), 0);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int iter = 0; iter < numJobs; ++iter) {
+		isDecoded[iter] = jobs[iter].m_decode(*jobs[iter].m_file,
+											*jobs[iter].m_info,
+											jobs[iter].m_data);
+	}
+	const std::vector<char>::const_iterator failed = std::find(
+											isDecoded.begin(), isDecoded.end(), 0);
+	if (failed != isDecoded.end()) {
+		const MatDecodeJob& job = jobs[static_cast<size_t>(
+										failed - isDecoded.begin())];
+		mexErrMsgIdAndTxt("MATLAB:mex", "Variable %s of MAT file %s is "
+						"corrupt.\n", job.m_info->m_name.c_str(),
+						job.m_file->getFileName().c_str());
+	}
+}
+
+}  // namespace detail
+
+/*
+ * Loads a batch of variables from any number of MAT files, returned in the
+ * order of requests. Real numeric variables of v5/v7 files, compressed or not,
+ * are decoded natively and concurrently on the OpenMP thread team (sized by
+ * OMP_NUM_THREADS), into arrays allocated beforehand on the calling thread.
+ * All other variables, and all variables of v7.3 files, are read through the
+ * MAT-file API, one at a time on the calling thread, since it is not
+ * thread-safe.
+ */
+inline std::vector<MxArray> loadVariables(
+									const std::vector<MatLoadRequest>& requests) {
+	detail::MatBatchFiles files;
+	std::vector<detail::MatDecodeJob> jobs;
+	std::vector<MxArray> retArg(requests.size());
+	for (size_t iter = 0, end = requests.size(); iter < end; ++iter) {
+		const MatMappedFile* file = files.getMappedFile(requests[iter].m_fileName);
+		const MatVariableInfo* info = (file != nullptr)
+						? &file->getVariableInfo(requests[iter].m_variableName)
+						: nullptr;
+		if (detail::isNativelyDecodable(file, info)) {
+			retArg[iter] = MxArray(detail::createNumericArray(
+												info->m_dimensions.size(),
+												info->m_dimensions.data(),
+												info->m_class, false));
+			jobs.push_back(detail::MatDecodeJob{file, info, nullptr, nullptr});
+			visitNumeric(retArg[iter], detail::MatDecodeJobBinder{jobs.back()});
+		} else {
+			retArg[iter] = files.readVariable(requests[iter].m_fileName,
+											requests[iter].m_variableName);
+		}
+	}
+	detail::runMatDecodeJobs(jobs);
+	return retArg;
+}
+
+/*
+ * As loadVariables, for variables that are all of the class of NumericType.
+ */
+template <typename NumericType>
+inline std::vector<MxNumeric<NumericType> > loadNumericVariables(
+									const std::vector<MatLoadRequest>& requests) {
+	detail::MatBatchFiles files;
+	std::vector<detail::MatDecodeJob> jobs;
+	std::vector<MxNumeric<NumericType> > retArg(requests.size());
+	for (size_t iter = 0, end = requests.size(); iter < end; ++iter) {
+		const MatMappedFile* file = files.getMappedFile(requests[iter].m_fileName);
+		const MatVariableInfo* info = (file != nullptr)
+						? &file->getVariableInfo(requests[iter].m_variableName)
+						: nullptr;
+		if (detail::isNativelyDecodable(file, info)) {
+			if (info->m_class != MxNumericClass<NumericType>::m_classId) {
+				mexErrMsgIdAndTxt("MATLAB:mex", "Variable %s is of class %s.\n",
+								info->m_name.c_str(),
+								detail::getClassIdName(info->m_class).c_str());
+			}
+			retArg[iter] = MxNumeric<NumericType>(kUninitialized,
+												info->m_dimensions);
+			jobs.push_back(detail::MatDecodeJob{file, info, retArg[iter].getData(),
+									&detail::decodeMatVariable<NumericType>});
+		} else {
+			retArg[iter] = MxNumeric<NumericType>(files.readVariable(
+											requests[iter].m_fileName,
+											requests[iter].m_variableName)
+											.get_array());
+		}
+	}
+	detail::runMatDecodeJobs(jobs);
+	return retArg;
+}
+
+namespace detail {
+
+/*
+ * Uncompressed bytes deflated by each task of MatParallelOutputFile, and the
+ * deflate window, which each task primes with the bytes before its block so
+ * that splitting costs little compression.
+ */
+const size_t kMatDeflateBlockSize = 1 << 20;
+const size_t kMatDeflateWindowSize = 1 << 15;
+const size_t kMatDeflateBlocksPerThread = 4;
+
+inline void appendMatBytes(std::vector<char>& buffer, const void* data,
+						const size_t numBytes) {
+	const char* bytes = static_cast<const char*>(data);
+	buffer.insert(buffer.end(), bytes, bytes + numBytes);
+}
+
+inline void appendMatTag(std::vector<char>& buffer,
+						const std::uint32_t dataType,
+						const std::uint32_t numBytes) {
+	const std::uint32_t words[2] = {dataType, numBytes};
+	appendMatBytes(buffer, words, sizeof(words));
+}
+
+/*
+ * Appends a whole element, in the small format if the data fits in the tag.
+ */
+inline void appendMatElement(std::vector<char>& buffer,
+							const std::uint32_t dataType, const void* data,
+							const size_t numBytes) {
+	const char kZeros[kMatTagSize] = {};
+	if (numBytes <= kMatTagSize / 2) {
+		const std::uint32_t word = (static_cast<std::uint32_t>(numBytes) << 16)
+								| dataType;
+		appendMatBytes(buffer, &word, sizeof(word));
+		appendMatBytes(buffer, data, numBytes);
+		appendMatBytes(buffer, kZeros, kMatTagSize / 2 - numBytes);
+		return;
+	}
+	appendMatTag(buffer, dataType, static_cast<std::uint32_t>(numBytes));
+	appendMatBytes(buffer, data, numBytes);
+	appendMatBytes(buffer, kZeros, getMatPadding(numBytes));
+}
+
+/*
+ * miMATRIX element of a variable to write: the element up to the tag of its
+ * real part, encoded, then the data of the array, read in place, and the
+ * padding.
+ */
+struct MatEncodedVariable {
+	std::vector<char> m_header;
+	const char* m_data;
+	size_t m_dataBytes;
+
+	inline size_t size() const {
+		return m_header.size() + m_dataBytes + getMatPadding(m_dataBytes);
+	}
+
+	/*
+	 * Calls function(data, numBytes) on the contiguous pieces of the bytes
+	 * [begin, end) of the element.
+	 */
+	template <typename Function>
+	inline void forEachPiece(const size_t begin, const size_t end,
+							Function function) const {
+		static const char kZeros[kMatTagSize] = {};
+		const char* pieces[3] = {m_header.data(), m_data, kZeros};
+		const size_t sizes[3] = {m_header.size(), m_dataBytes,
+								getMatPadding(m_dataBytes)};
+		size_t pieceBegin = 0;
+		for (size_t iter = 0; iter < 3; ++iter) {
+			const size_t pieceEnd = pieceBegin + sizes[iter];
+			const size_t first = std::max(begin, pieceBegin);
+			const size_t last = std::min(end, pieceEnd);
+			if (first < last) {
+				function(pieces[iter] + (first - pieceBegin), last - first);
+			}
+			pieceBegin = pieceEnd;
+		}
+	}
+};
+
+inline MatEncodedVariable encodeMatVariable(const MxArray& variable,
+										const std::string& variableName) {
+	const PMxArrayNative array = variable.get_array();
+	mexAssertEx((mxIsNumeric(array) || mxIsLogical(array))
+				&& !mxIsComplex(array) && !mxIsSparse(array),
+				"Only real numeric and logical variables are written natively; "
+				"use MatFile");
+	const mxClassID classId = mxGetClassID(array);
+	const std::uint32_t flags[2] = {(classId == mxLOGICAL_CLASS)
+									? (kMatFlagLogical | mxUINT8_CLASS)
+									: static_cast<std::uint32_t>(classId), 0};
+	const mwSize numDims = mxGetNumberOfDimensions(array);
+	const mwSize* dims = mxGetDimensions(array);
+	std::vector<INT32_T> fileDims(numDims);
+	for (mwSize iter = 0; iter < numDims; ++iter) {
+		mexAssertEx(dims[iter] <= static_cast<mwSize>(INT32_MAX),
+					"Dimension too large for a v7 MAT file");
+		fileDims[iter] = static_cast<INT32_T>(dims[iter]);
+	}
+
+	MatEncodedVariable retArg;
+	retArg.m_data = static_cast<const char*>(mxGetData(array));
+	retArg.m_dataBytes = mxGetNumberOfElements(array) * mxGetElementSize(array);
+	appendMatTag(retArg.m_header, kMiMatrix, 0);
+	appendMatElement(retArg.m_header, kMiUint32, flags, sizeof(flags));
+	appendMatElement(retArg.m_header, kMiInt32, fileDims.data(),
+					fileDims.size() * sizeof(INT32_T));
+	appendMatElement(retArg.m_header, kMiInt8, variableName.data(),
+					variableName.size());
+	mexAssertEx(retArg.size() <= UINT32_MAX,
+				"Variable too large for a v7 MAT file");
+	appendMatTag(retArg.m_header, getMatDataType(classId),
+				static_cast<std::uint32_t>(retArg.m_dataBytes));
+	const std::uint32_t numBytes = static_cast<std::uint32_t>(retArg.size()
+															- kMatTagSize);
+	std::memcpy(&retArg.m_header[sizeof(std::uint32_t)], &numBytes,
+				sizeof(numBytes));
+	return retArg;
+}
+
+/*
+ * Bytes [m_begin, m_end) of the element of variable m_variable, deflated on
+ * their own as raw deflate data. Blocks end on a byte boundary (a sync flush),
+ * and the last block of a variable ends the deflate stream, so that the
+ * blocks of a variable concatenate into one stream. m_adler is the Adler-32
+ * of the uncompressed bytes, to combine into that of the stream.
+ */
+struct MatDeflateBlock {
+	size_t m_variable;
+	size_t m_begin;
+	size_t m_end;
+	std::vector<char> m_output;
+	uLong m_adler;
+};
+
+inline bool deflateMatBlock(const MatEncodedVariable& variable,
+						const int compressionLevel, MatDeflateBlock& block) {
+	z_stream stream = z_stream();
+	if (deflateInit2(&stream, compressionLevel, Z_DEFLATED, -MAX_WBITS, 8,
+					Z_DEFAULT_STRATEGY) != Z_OK) {
+		return false;
+	}
+	if (block.m_begin > 0) {
+		std::vector<char> dictionary;
+		variable.forEachPiece(
+					block.m_begin - std::min(block.m_begin,
+											kMatDeflateWindowSize),
+					block.m_begin,
+					[&dictionary](const char* data, const size_t numBytes) {
+						appendMatBytes(dictionary, data, numBytes);
+					});
+		deflateSetDictionary(&stream,
+						reinterpret_cast<const Bytef*>(dictionary.data()),
+						static_cast<uInt>(dictionary.size()));
+	}
+	block.m_output.resize(deflateBound(&stream, block.m_end - block.m_begin)
+						+ kMatTagSize);
+	stream.next_out = reinterpret_cast<Bytef*>(block.m_output.data());
+	stream.avail_out = static_cast<uInt>(block.m_output.size());
+	block.m_adler = adler32(0L, nullptr, 0);
+	bool isDeflated = true;
+	variable.forEachPiece(block.m_begin, block.m_end,
+					[&stream, &block, &isDeflated](const char* data,
+												const size_t numBytes) {
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		stream.avail_in = static_cast<uInt>(numBytes);
+		block.m_adler = adler32(block.m_adler, stream.next_in,
+								stream.avail_in);
+		isDeflated = isDeflated && (deflate(&stream, Z_NO_FLUSH) == Z_OK)
+					&& (stream.avail_in == 0);
+	});
+	const bool isLast = (block.m_end == variable.size());
+	const int status = deflate(&stream, isLast ? Z_FINISH : Z_SYNC_FLUSH);
+	isDeflated = isDeflated && (status == (isLast ? Z_STREAM_END : Z_OK))
+				&& (stream.avail_out > 0);
+	block.m_output.resize(stream.total_out);
+	deflateEnd(&stream);
+	return isDeflated;
+}
+
+}  // namespace detail
+
+/*
+ * Writes a v7 MAT file (v5 with compressed variables) natively, compressing
+ * on the OpenMP thread team instead of on one thread in matPutVariable. The
+ * element of every variable is cut into blocks of
+ * detail::kMatDeflateBlockSize, which are deflated in parallel, whether they
+ * come from many variables or from one large one, and written in order as a
+ * single zlib stream per variable. Blocks are processed a few per thread at a
+ * time, so memory use beyond the variables themselves stays small.
+ *
+ * compressionLevel is that of zlib, 1 (fastest) to 9 (smallest), or
+ * Z_DEFAULT_COMPRESSION; 0 writes the variables uncompressed without going
+ * through zlib at all, which MATLAB loads just as well. Only real numeric and
+ * logical variables are supported, and variables must be below 4 GB, as with
+ * save -v7. writeVariable does not copy the data: it is read when the file is
+ * flushed, so the variables must stay alive and unchanged until then. Call
+ * flush once all variables are written: the destructor writes whatever is
+ * left, but cannot raise errors, so failures there go unreported.
+ */
+class MatParallelOutputFile {
+public:
+	explicit MatParallelOutputFile(const std::string& fileName,
+								const int compressionLevel =
+													Z_DEFAULT_COMPRESSION) :
+			m_file(fileName.c_str(), std::ios::binary | std::ios::trunc),
+			m_compressionLevel(compressionLevel),
+			m_variables() {
+		mexAssertEx(m_file.is_open(), "Cannot create MAT file");
+		mexAssertEx((compressionLevel >= Z_DEFAULT_COMPRESSION)
+					&& (compressionLevel <= Z_BEST_COMPRESSION),
+					"Invalid compression level");
+		std::string header("MATLAB 5.0 MAT-file, written by mex_utils");
+		header.resize(detail::kMatHeaderSize - 12, ' ');
+		header.append(8, '\0');
+		const std::uint16_t version = 0x0100;
+		header.append(reinterpret_cast<const char*>(&version), sizeof(version));
+		header.append("IM");
+		m_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+	}
+
+	MatParallelOutputFile(const MatParallelOutputFile& other) = delete;
+	MatParallelOutputFile& operator=(const MatParallelOutputFile& other)
+																	= delete;
+	MatParallelOutputFile(MatParallelOutputFile&& other) = delete;
+	MatParallelOutputFile& operator=(MatParallelOutputFile&& other) = delete;
+
+	inline void writeVariable(const MxArray& variable,
+							const std::string& variableName) {
+		m_variables.push_back(detail::encodeMatVariable(variable,
+														variableName));
+	}
+
+	inline void writeVariable(const MxVariable& variable) {
+		writeVariable(variable.m_array, variable.m_name);
+	}
+
+	/*
+	 * Writes the variables queued so far.
+	 */
+	inline void flush() {
+		if (!writeVariables()) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Cannot write MAT file; a "
+							"variable failed to compress or is too large for "
+							"a v7 MAT file.\n");
+		}
+	}
+
+	~MatParallelOutputFile() {
+		if (!m_variables.empty()) {
+			writeVariables();
+		}
+	}
+
+private:
+	inline bool writeVariables() {
+		bool isWritten = true;
+		if (m_compressionLevel == 0) {
+			for (size_t iter = 0, end = m_variables.size(); iter < end; ++iter) {
+				m_variables[iter].forEachPiece(0, m_variables[iter].size(),
+										[this](const char* data,
+												const size_t numBytes) {
+					m_file.write(data, static_cast<std::streamsize>(numBytes));
+				});
+			}
+		} else {
+			isWritten = writeCompressed();
+		}
+		m_variables.clear();
+		m_file.flush();
+		return isWritten && m_file.good();
+	}
+
+	inline bool writeCompressed() {
+		std::vector<detail::MatDeflateBlock> blocks;
+		for (size_t iter = 0, end = m_variables.size(); iter < end; ++iter) {
+			const size_t size = m_variables[iter].size();
+			for (size_t begin = 0; begin < size;
+				begin += detail::kMatDeflateBlockSize) {
+				blocks.push_back(detail::MatDeflateBlock{iter, begin,
+							std::min(begin + detail::kMatDeflateBlockSize, size),
+							std::vector<char>(), 0});
+			}
+		}
+
+		const size_t windowSize = detail::kMatDeflateBlocksPerThread
+								* detail::getMaxThreads();
+		std::streampos tagPosition = 0;
+		uLong adler = 0;
+		size_t numBytes = 0;
+		for (size_t windowBegin = 0, numBlocks = blocks.size();
+			windowBegin < numBlocks; windowBegin += windowSize) {
+			const size_t windowEnd = std::min(windowBegin + windowSize,
+											numBlocks);
+			const int numWindowBlocks = static_cast<int>(windowEnd
+														- windowBegin);
+			std::vector<char> isDeflated(windowEnd - windowBegin, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+			for (int iter = 0; iter < numWindowBlocks; ++iter) {
+				detail::MatDeflateBlock& block = blocks[windowBegin + iter];
+				isDeflated[iter] = detail::deflateMatBlock(
+												m_variables[block.m_variable],
+												m_compressionLevel, block);
+			}
+			if (std::find(isDeflated.begin(), isDeflated.end(), 0)
+				!= isDeflated.end()) {
+				return false;
+			}
+
+			for (size_t iter = windowBegin; iter < windowEnd; ++iter) {
+				detail::MatDeflateBlock& block = blocks[iter];
+				if (block.m_begin == 0) {
+					const std::uint32_t tag[2] = {detail::kMiCompressed, 0};
+					const unsigned char zlibHeader[2] = {0x78, 0x9C};
+					tagPosition = m_file.tellp();
+					m_file.write(reinterpret_cast<const char*>(tag), sizeof(tag));
+					m_file.write(reinterpret_cast<const char*>(zlibHeader),
+								sizeof(zlibHeader));
+					adler = adler32(0L, nullptr, 0);
+					numBytes = sizeof(zlibHeader);
+				}
+				m_file.write(block.m_output.data(),
+							static_cast<std::streamsize>(block.m_output.size()));
+				numBytes += block.m_output.size();
+				adler = adler32_combine(adler, block.m_adler,
+								static_cast<z_off_t>(block.m_end - block.m_begin));
+				std::vector<char>().swap(block.m_output);
+				if (block.m_end == m_variables[block.m_variable].size()) {
+					const unsigned char trailer[4] = {
+									static_cast<unsigned char>(adler >> 24),
+									static_cast<unsigned char>(adler >> 16),
+									static_cast<unsigned char>(adler >> 8),
+									static_cast<unsigned char>(adler)};
+					m_file.write(reinterpret_cast<const char*>(trailer),
+								sizeof(trailer));
+					numBytes += sizeof(trailer);
+					if (numBytes > UINT32_MAX) {
+						return false;
+					}
+					const std::uint32_t elementBytes =
+											static_cast<std::uint32_t>(numBytes);
+					m_file.seekp(tagPosition
+								+ static_cast<std::streamoff>(
+													sizeof(std::uint32_t)));
+					m_file.write(reinterpret_cast<const char*>(&elementBytes),
+								sizeof(elementBytes));
+					m_file.seekp(0, std::ios::end);
+				}
+			}
+		}
+		return true;
+	}
+
+	std::ofstream m_file;
+	const int m_compressionLevel;
+	std::vector<detail::MatEncodedVariable> m_variables;
 };
 
+/*
+ * v5 files are indexed by a scan of their element tags, as MatMappedFile does,
+ * which also locates each variable. Other files go through the MAT-file API on
+ * a handle of their own, so that the position of getNextVariableInfo is left
+ * alone; with MAT_UTILS_USE_HDF5, the datasets of v7.3 files are then located
+ * through HDF5.
+ */
+inline void MatFile::buildIndex() const {
+	m_index.clear();
+	m_names.clear();
+	const std::uint16_t version = detail::getMatFileVersion(m_fileName);
+	if (version == 0x0100) {
+		const MatMappedFile file(m_fileName);
+		const std::vector<MatVariableInfo>& variables = file.getVariables();
+		for (size_t iter = 0, end = variables.size(); iter < end; ++iter) {
+			addToIndex(variables[iter].m_name,
+					MatIndexEntry{MxArrayHeader(variables[iter].m_class,
+											variables[iter].m_dimensions),
+								variables[iter].m_offset,
+								variables[iter].m_size});
+		}
+		return;
+	}
+
+	MATFile* file = matOpen(m_fileName.c_str(), "r");
+	mexAssert(file != nullptr);
+	const char* variableName;
+	for (mxArray* header = matGetNextVariableInfo(file, &variableName);
+		header != nullptr;
+		header = matGetNextVariableInfo(file, &variableName)) {
+		addToIndex(variableName, MatIndexEntry{MxArrayHeader(header), 0, 0});
+		mxDestroyArray(header);
+	}
+	matClose(file);
+
+#ifdef MAT_UTILS_USE_HDF5
+	const hid_t hdf5File = (version == 0x0200) ? H5Fopen(m_fileName.c_str(),
+														H5F_ACC_RDONLY,
+														H5P_DEFAULT)
+												: -1;
+	for (size_t iter = 0, end = m_names.size();
+		(hdf5File >= 0) && (iter < end); ++iter) {
+		const hid_t object = H5Oopen(hdf5File, m_names[iter].c_str(),
+									H5P_DEFAULT);
+		if ((object >= 0) && (H5Iget_type(object) == H5I_DATASET)) {
+			const haddr_t offset = H5Dget_offset(object);
+			MatIndexEntry& entry = m_index.find(m_names[iter])->second;
+			entry.m_offset = (offset != HADDR_UNDEF)
+							? static_cast<size_t>(offset) : 0;
+			entry.m_size = static_cast<size_t>(H5Dget_storage_size(object));
+		}
+		if (object >= 0) {
+			H5Oclose(object);
+		}
+	}
+	if (hdf5File >= 0) {
+		H5Fclose(hdf5File);
+	}
+#endif
+}
+
 }	/* namespace mex */
 
 #endif /* MAT_UTILS_H_ */
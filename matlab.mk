@@ -11,5 +11,9 @@ MATLABINCLUDE = -I$(MATLABDIR)/extern/include
 INCLUDES += $(MATLABINCLUDE)
 
 MEXFLAGS = -DMATLAB_MEX_FILE -D_GNU_SOURCE -fexceptions -fno-omit-frame-pointer
+ifeq ($(USE_INTERLEAVED_COMPLEX), 1)
+	MEXFLAGS += -DMATLAB_DEFAULT_RELEASE=R2018a
+	LIBS += $(MATLABDIR)/extern/version/cpp_mexapi_version.cpp
+endif
 CFLAGS += $(MEXFLAGS)
 LDFLAGS += -pthread -shared -Wl,--version-script,$(MATLABDIR)/extern/lib/$(MATLABARCH)/$(MAPFILE) -Wl,--no-undefined
@@ -10,36 +10,37 @@
 
 #include <algorithm>
 #include <array>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <numeric>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 /*
  * TODO: Replace mex includes with extern declarations, to avoid namespace
  * contamination.
- * TODO: Add a nargin/out checker.
  */
 #include "mex.h"
 #include "matrix.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /*
- * TODO: Add struct array support.
  * TODO: Add support for initialization by const mxArray*. Probably will need to
  * create const_MxArray class and class hierarchy.
  * TODO: Is giving access to a data element with [] in MxCell and MxStruct
  * equivalent to using mxSetCell and mxSetField, respectively?
- * TODO: Add general matrix views to avoid permute when possible?
- * TODO: Maybe add support for mxSetData? Would be unsafe.
- * TODO: Find way to do safe resource management when a malloc occurs
- * (construction is not done by an already existing PMxArrayNative). Maybe using
- * some smart (unique) pointer, or using ownwer member.
- * TODO: Update to take advantage of C++11 move semantics, especially for better
- * safety.
- * TODO: Provide iterators for easy use with STL and new C++11 loops.
- * TODO: Maybe provide StringCell specialization.
  * TODO: When creating from raw mxArray*, add assert to check that data is not
  * null.
  * TODO: Find way to remove call to get_class, or change its return type to
@@ -67,6 +68,7 @@ namespace mex {
 
 struct MxClass {
 	static constexpr mxClassID m_classId = mxUNKNOWN_CLASS;
+	static constexpr mxComplexity m_complexity = mxREAL;
 };
 
 
@@ -107,7 +109,7 @@ template <> struct MxNumericClass<UINT32_T> : public MxClass {
 template <> struct MxNumericClass<INT32_T> : public MxClass {
 	static constexpr mxClassID m_classId = mxINT32_CLASS;
 };
-template <> struct MxNumericClass<UINT64_T> {
+template <> struct MxNumericClass<UINT64_T> : public MxClass {
 	static constexpr mxClassID m_classId = mxUINT64_CLASS;
 };
 template <> struct MxNumericClass<INT64_T> : public MxClass {
@@ -123,6 +125,25 @@ template <> struct MxNumericClass<mxLogical> : public MxClass {
 	static constexpr mxClassID m_classId = mxLOGICAL_CLASS;
 };
 
+/*
+ * Complex arrays are wrapped as MxNumeric<std::complex<T> > (or MxComplex<T>),
+ * directly on MATLAB's data. This needs the interleaved complex API
+ * (R2018a and later, with MATLAB_DEFAULT_RELEASE=R2018a, see matlab.mk), in
+ * which the real and imaginary parts of each element are adjacent, as in
+ * std::complex. With the separate complex API the parts are stored in two
+ * arrays, and complex types are not available.
+ */
+#if defined(MX_HAS_INTERLEAVED_COMPLEX) && MX_HAS_INTERLEAVED_COMPLEX
+template <typename NumericType>
+struct MxNumericClass<std::complex<NumericType> > : public MxClass {
+	static_assert(sizeof(std::complex<NumericType>) == 2 * sizeof(NumericType),
+				"std::complex is not laid out as two adjacent parts.");
+	static constexpr mxClassID m_classId =
+									MxNumericClass<NumericType>::m_classId;
+	static constexpr mxComplexity m_complexity = mxCOMPLEX;
+};
+#endif
+
 struct MxStringClass : public MxClass {
 	static constexpr mxClassID m_classId = mxCHAR_CLASS;
 };
@@ -137,6 +158,22 @@ struct MxStructClass : public MxClass {
 
 namespace detail {
 using PMxArrayNative = mxArray*;
+
+/*
+ * Whether the data of array can be read as NumericType. With the interleaved
+ * complex API, complex data only match complex types. With the separate API,
+ * the data of a complex array are its real part.
+ */
+template <typename NumericType>
+inline bool isNumericClass(const PMxArrayNative array) {
+	return (MxNumericClass<NumericType>::m_classId == mxGetClassID(array))
+#if defined(MX_HAS_INTERLEAVED_COMPLEX) && MX_HAS_INTERLEAVED_COMPLEX
+		&& ((MxNumericClass<NumericType>::m_complexity == mxCOMPLEX)
+			== mxIsComplex(array))
+#endif
+		;
+}
+
 }  // namespace detail
 
 class MxArray {
@@ -234,7 +271,7 @@ public:
 
 	template <typename NumericType>
 	inline bool isNumeric() const {
-		return (getClass() == MxNumericClass<NumericType>::m_classId);
+		return detail::isNumericClass<NumericType>(get_array());
 	}
 
 	inline bool isString() const {
@@ -256,630 +293,4285 @@ public:
 	virtual ~MxArray() = default;
 
 private:
-	detail::PMxArrayNative m_array;
+	detail::PMxArrayNative m_array = nullptr;
 };
 
-namespace detail {
-using PMxArray = MxArray*;
-using array2D = std::array<mwSize, 2>;
-}  // namespace detail
-
-template <typename NumericType>
-class MxNumeric : public MxArray {
+/*
+ * Owning, move-only holder of an array, in the spirit of std::unique_ptr. The
+ * array is destroyed when the holder goes out of scope, unless release() has
+ * handed it over, e.g. to plhs or to a cell or struct. The typed wrapper is
+ * reachable through get(), * and ->, and can be copied out as a non-owning
+ * wrapper as usual.
+ */
+template <typename MxArrayType = MxArray>
+class MxUniqueArray {
 public:
-	MxNumeric() = default;
-	MxNumeric(const MxNumeric<NumericType>& other) = default;
-	MxNumeric<NumericType>& operator=(const MxNumeric<NumericType>& other)
-																	= default;
-	MxNumeric(MxNumeric<NumericType>&& other) = default;
-	MxNumeric<NumericType>& operator=(MxNumeric<NumericType>&& other) = default;
-
-	explicit MxNumeric(const detail::PMxArrayNative array) :
-			MxArray(array) {
-		mexAssert(MxNumericClass<NumericType>::m_classId == mxGetClassID(array));
+	MxUniqueArray() = default;
+	MxUniqueArray(const MxUniqueArray<MxArrayType>& other) = delete;
+	MxUniqueArray<MxArrayType>& operator=(
+							const MxUniqueArray<MxArrayType>& other) = delete;
+
+	MxUniqueArray(MxUniqueArray<MxArrayType>&& other) :
+			m_wrapper(other.m_wrapper) {
+		other.m_wrapper = MxArrayType();
 	}
 
-	/*
-	 * TODO: Find way to avoid the dims cast when mwSize IndexType is used.
-	 */
-	template <typename IndexType>
-	MxNumeric(const NumericType* arrVar,
-			const IndexType numDims,
-			const IndexType *dims) :
-			MxNumeric(mxCreateNumericArray(static_cast<mwSize>(numDims),
-										std::vector<mwSize>(dims,
-															dims + numDims)
-															.data(),
-										MxNumericClass<NumericType>::m_classId,
-										mxREAL)) {
-		if (arrVar != nullptr) {
-			NumericType *val = static_cast<NumericType*>(mxGetData(
-																get_array()));
-			std::memcpy(static_cast<void*>(val),
-						static_cast<const void*>(arrVar),
-						getNumberOfElements<size_t>() * sizeof(NumericType));
+	MxUniqueArray<MxArrayType>& operator=(MxUniqueArray<MxArrayType>&& other) {
+		if (this != &other) {
+			reset();
+			m_wrapper = other.m_wrapper;
+			other.m_wrapper = MxArrayType();
 		}
+		return *this;
 	}
 
-	template <typename IndexType>
-	MxNumeric(const IndexType numDims, const IndexType *dims) :
-			MxNumeric(nullptr, numDims, dims) {}
-
-	template <typename IndexType>
-	MxNumeric(const IndexType numRows, const IndexType numColumns) :
-			MxNumeric(nullptr, static_cast<mwSize>(2),
-					detail::array2D{numRows, numColumns}.data()) {}
-
-	template <typename IndexType>
-	MxNumeric(const NumericType* arrVar, const IndexType numRows,
-			const IndexType numColumns) :
-			MxNumeric(arrVar, static_cast<mwSize>(2),
-					detail::array2D{numRows, numColumns}.data()) {}
-
-	explicit MxNumeric(const std::vector<NumericType>& vecVar) :
-			MxNumeric(vecVar.data(), static_cast<mwSize>(2),
-					detail::array2D{vecVar.size(), 1}.data()) {}
-
-	template <std::size_t ArraySize>
-	explicit MxNumeric(const std::array<NumericType, ArraySize>& arrVar) :
-			MxNumeric(arrVar.data(), static_cast<mwSize>(2),
-					detail::array2D{ArraySize, 1}.data()) {}
+	/*
+	 * Takes ownership of the array of another holder, checking its class.
+	 */
+	template <typename OtherMxArrayType>
+	explicit MxUniqueArray(MxUniqueArray<OtherMxArrayType>&& other) :
+			m_wrapper(other.release()) {}
 
-	explicit MxNumeric(const NumericType scalarVar) :
-			MxNumeric(&scalarVar, static_cast<mwSize>(2),
-					detail::array2D{1, 1}.data()) {}
+	/*
+	 * Takes ownership of the array wrapped by array.
+	 */
+	explicit MxUniqueArray(const MxArrayType& array) :
+			m_wrapper(array) {}
 
-	template <typename IndexType>
-	MxNumeric(const NumericType* arrVar, const std::vector<IndexType>& dims) :
-			MxNumeric(arrVar, dims.size(), dims.data()) {}
+	explicit MxUniqueArray(const detail::PMxArrayNative array) :
+			m_wrapper(array) {}
 
-	template <typename IndexType>
-	inline NumericType& operator[](IndexType i) {
-		mexAssert(i < getNumberOfElements<IndexType>());
-		NumericType* temp = static_cast<NumericType*>(mxGetData(get_array()));
-		return temp[i];
+	inline const MxArrayType& get() const {
+		return m_wrapper;
 	}
 
-	template <typename IndexType>
-	inline const NumericType& operator[](IndexType i) const {
-		mexAssert(i < getNumberOfElements<IndexType>());
-		NumericType* temp = static_cast<NumericType*>(mxGetData(get_array()));
-		return temp[i];
+	inline MxArrayType& get() {
+		return m_wrapper;
 	}
 
-	inline const NumericType* getData() const {
-		return static_cast<const NumericType*>(mxGetData(get_array()));
+	inline const MxArrayType& operator*() const {
+		return m_wrapper;
 	}
 
-	inline NumericType* getData() {
-		return static_cast<NumericType*>(mxGetData(get_array()));
+	inline MxArrayType& operator*() {
+		return m_wrapper;
 	}
 
-	inline std::vector<NumericType> vectorize() const {
-		int numel = getNumberOfElements();
-		const NumericType* pData = getData();
-		return std::vector<NumericType>(pData, pData + numel);
+	inline const MxArrayType* operator->() const {
+		return &m_wrapper;
 	}
 
-	template <typename IndexType>
-	inline std::vector<IndexType> ind2sub(IndexType index) const {
-		mexAssert(index < getNumberOfElements<IndexType>());
-		std::vector<IndexType> dimensions = getDimensions<IndexType>();
-		std::vector<IndexType> subscript(getNumberOfDimensions<size_t>());
-		IndexType sliceSize = getNumberOfElements<IndexType>();
-		for (int iter = 0, end = getNumberOfDimensions(); iter < end; ++iter) {
-			sliceSize /= dimensions[end - 1 - iter];
-			subscript[end - 1 - iter] = index / sliceSize;
-			index %= sliceSize;
-		}
-		return subscript;
+	inline MxArrayType* operator->() {
+		return &m_wrapper;
 	}
 
-	template <typename IndexType>
-	inline IndexType sub2ind(const std::vector<IndexType>& subscript) const {
-		std::vector<IndexType> dimensions = getDimensions<IndexType>();
-		mexAssert(subscript.size() == getNumberOfDimensions<size_t>());
-		for (int iter = 0, end = getNumberOfDimensions();
-			iter < end;
-			++iter) {
-			mexAssert(subscript[iter] < dimensions[iter]);
-		}
-		IndexType index = 0;
-		IndexType sliceSize = getNumberOfElements<IndexType>();
-		for (int iter = 0, end = getNumberOfDimensions(); iter < end; ++iter) {
-			sliceSize /= dimensions[end - 1 - iter];
-			index += subscript[end - 1 - iter] * sliceSize;
-		}
-		return index;
+	explicit operator bool() const {
+		return (m_wrapper.get_array() != nullptr);
 	}
 
 	/*
-	 * TODO: Very cache-unfriendly and out-of-place multidimensional permute.
+	 * Gives up ownership, e.g. plhs[0] = array.release().
 	 */
-	template <typename IndexType>
-	MxNumeric<NumericType> permute(
-								const std::vector<IndexType>& indexPermutation)
-								const {
-		mexAssert(isIndexPermutation(indexPermutation));
-		const std::vector<IndexType> dimensions = getDimensions<IndexType>();
-		const std::vector<IndexType> permutedDimensions = permuteIndexVector(
-															dimensions,
-															indexPermutation);
-		MxNumeric<NumericType> retArg(static_cast<IndexType>(
-													permutedDimensions.size()),
-									&permutedDimensions[0]);
-		const NumericType* thisData = getData();
-		NumericType* otherData = retArg.getData();
-		for (IndexType iter = 0,
-			end = static_cast<IndexType>(getNumberOfElements());
-			iter < end;
-			++iter) {
-			otherData[retArg.sub2ind(permuteIndexVector(ind2sub(iter),
-														indexPermutation))]
-			          	  	  	  	  	  	  	  	  	= thisData[iter];
-		}
-		return retArg;
+	inline detail::PMxArrayNative release() {
+		const detail::PMxArrayNative array = m_wrapper.get_array();
+		m_wrapper = MxArrayType();
+		return array;
 	}
 
-	virtual ~MxNumeric() = default;
-
-private:
-	template <typename IndexType>
-	inline bool isIndexPermutation(
-								const std::vector<IndexType>& indexPermutation)
-								const {
-		if (indexPermutation.size() != getNumberOfDimensions<size_t>()) {
-			return false;
-		}
-		std::vector<IndexType> indexVector;
-		for (IndexType iter = 0,
-			end = getNumberOfDimensions<IndexType>();
-			iter < end;
-			++iter) {
-			indexVector.push_back(iter + 1);
-		}
-		typename std::vector<IndexType>::const_iterator first(
-													indexPermutation.begin());
-		typename std::vector<IndexType>::const_iterator last(
-													indexPermutation.end());
-		typename std::vector<IndexType>::iterator d_first(indexVector.begin());
-		if (first != last) {
-			typename std::vector<IndexType>::iterator d_last = d_first;
-			std::advance(d_last, std::distance(first, last));
-			for (typename std::vector<IndexType>::const_iterator i = first;
-				i != last;
-				++i) {
-				if (i != std::find(first, i, *i)) {
-					continue;  // already counted this *i
-				}
-
-				IndexType m = std::count(d_first, d_last, *i);
-				if (m == 0 || std::count(i, last, *i) != m) {
-					return false;
-				}
-			}
+	inline void reset() {
+		if (m_wrapper.get_array() != nullptr) {
+			m_wrapper.destroy();
+			m_wrapper = MxArrayType();
 		}
-		return true;
 	}
 
-	template <typename IndexType>
-	inline std::vector<IndexType> permuteIndexVector(
-							const std::vector<IndexType>& indexVector,
-							const std::vector<IndexType>& indexPermutation)
-							const {
-		std::vector<IndexType> permutedIndexVector(indexVector.size(), 0);
-		for (IndexType iter = 0, end = indexVector.size(); iter < end; ++iter) {
-			permutedIndexVector[iter] = indexVector[indexPermutation[iter] - 1];
-		}
-		return permutedIndexVector;
+	~MxUniqueArray() {
+		reset();
 	}
+
+private:
+	MxArrayType m_wrapper;
 };
 
-template <>
-inline MxNumeric<bool>::MxNumeric(const std::vector<bool>& vecVar) :
-		MxNumeric(static_cast<mwSize>(2),
-				detail::array2D{vecVar.size(), 1}.data()) {
-	bool* dataArray = getData();
-	int index = 0;
-	for (auto iter = std::begin(vecVar); iter < std::end(vecVar); ++iter) {
-		dataArray[index++] = *iter;
-	}
+/*
+ * Creates a new array with any of MxArrayType's constructors, owned by an
+ * MxUniqueArray.
+ */
+template <typename MxArrayType, typename... Args>
+inline MxUniqueArray<MxArrayType> makeUnique(Args&&... args) {
+	return MxUniqueArray<MxArrayType>(MxArrayType(std::forward<Args>(args)...));
 }
 
-template <> template <std::size_t ArraySize>
-inline MxNumeric<bool>::MxNumeric(const std::array<bool, ArraySize>& arrVar) :
-		MxNumeric(static_cast<mwSize>(2),
-				detail::array2D{ArraySize, 1}.data()) {
-	bool* dataArray = getData();
-	int index = 0;
-	for (auto iter = std::begin(arrVar); iter < std::end(arrVar); ++iter) {
-		dataArray[index++] = *iter;
-	}
+namespace detail {
+using PMxArray = MxArray*;
+using array2D = std::array<mwSize, 2>;
+
+/*
+ * Splits the range [0, total) evenly between the threads of the enclosing
+ * OpenMP parallel region, and returns the part of the calling thread.
+ */
+inline void getThreadRange(const mwSize total, mwSize& begin, mwSize& end) {
+#ifdef _OPENMP
+	const mwSize numThreads = static_cast<mwSize>(omp_get_num_threads());
+	const mwSize thread = static_cast<mwSize>(omp_get_thread_num());
+#else
+	const mwSize numThreads = 1;
+	const mwSize thread = 0;
+#endif
+	begin = total / numThreads * thread
+			+ std::min(thread, total % numThreads);
+	end = begin + total / numThreads + ((thread < total % numThreads) ? 1 : 0);
 }
 
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 UInt128;
+#endif
+
 /*
- * TODO: For memory safety reasons, and because of MATLAB's internal
- * representation for "string-arrays", this is relatively memory inefficient.
+ * Unsigned division by a run-time invariant divisor, using a multiply and
+ * shifts instead of a hardware divide (Granlund and Montgomery, "Division by
+ * invariant integers using multiplication", 1994). Exact for all numerators.
+ * Falls back to plain division where 128-bit integers are not available.
  */
-class MxString: public MxArray {
+class FastDivisor {
 public:
+	FastDivisor() :
+			FastDivisor(1) {}
+
+	explicit FastDivisor(const mwSize divisor) :
+			m_divisor(divisor),
+			m_multiplier(0),
+			m_shift1(0),
+			m_shift2(0) {
+#ifdef __SIZEOF_INT128__
+		mexAssert(divisor != 0);
+		unsigned int log2Ceil = 0;
+		while ((log2Ceil < 64)
+			&& ((static_cast<UInt128>(1) << log2Ceil) < divisor)) {
+			++log2Ceil;
+		}
+		m_multiplier = static_cast<mwSize>(
+				(((static_cast<UInt128>(1) << log2Ceil) - divisor)
+					<< 64) / divisor + 1);
+		m_shift1 = std::min(log2Ceil, 1u);
+		m_shift2 = (log2Ceil > 0) ? (log2Ceil - 1) : 0;
+#endif
+	}
 
-	MxString() = default;
-	MxString(const MxString& other) = default;
-	MxString& operator=(const MxString& other) = default;
-	MxString(MxString&& other) = default;
-	MxString& operator=(MxString&& other) = default;
-
-	friend void swap(MxString& first, MxString& second) {
-		using std::swap;
-		swap(static_cast<MxArray&>(first), static_cast<MxArray&>(second));
-		swap(first.m_string, second.m_string);
+	inline mwSize divide(const mwSize numerator) const {
+#ifdef __SIZEOF_INT128__
+		const mwSize high = static_cast<mwSize>(
+				(static_cast<UInt128>(m_multiplier) * numerator) >> 64);
+		return (high + ((numerator - high) >> m_shift1)) >> m_shift2;
+#else
+		return numerator / m_divisor;
+#endif
 	}
 
-	explicit MxString(const detail::PMxArrayNative array) :
-			MxArray(array), m_string() {
-		mexAssert(MxStringClass::m_classId == mxGetClassID(array));
-		char* temp = mxArrayToString(get_array());
-		m_string = std::string(temp);
-		mxFree(temp);
+	inline mwSize get_divisor() const {
+		return m_divisor;
 	}
 
-	explicit MxString(const char* cString) :
-			MxArray(mxCreateString(cString)), m_string(cString) {}
+private:
+	mwSize m_divisor;
+	mwSize m_multiplier;
+	unsigned int m_shift1;
+	unsigned int m_shift2;
+};
 
-	explicit MxString(const std::string& string) :
-			MxString(string.c_str()) {}
+/*
+ * Bulk copy and fill, split in page-aligned blocks between OpenMP threads for
+ * large buffers, so that on NUMA systems the first touch of each page of a
+ * new (uninitialized) array happens on the thread that later works on it, and
+ * several memory controllers are used. Plain memcpy/fill below the threshold.
+ */
+const size_t kParallelCopyThreshold = 1 << 22;
+const size_t kPageSize = 4096;
 
-	inline void clone(const MxString& other) {
-		mexAssert(getDimensions() == other.getDimensions());
-		mxChar *destination = static_cast<mxChar*>(mxGetData(get_array()));
-		const mxChar *origin = static_cast<const mxChar*>(
-											mxGetData(other.get_array()));
+template <typename NumericType>
+inline void copyElements(NumericType* destination,
+						const NumericType* source,
+						const mwSize numel) {
+	const size_t numBytes = numel * sizeof(NumericType);
+	if (numBytes < kParallelCopyThreshold) {
 		std::memcpy(static_cast<void*>(destination),
-			static_cast<const void*>(origin),
-			getNumberOfElements<size_t>() * sizeof(mxChar));
-		m_string = other.get_string();
-	}
-
-	inline const std::string& get_string() const {
-		return m_string;
+					static_cast<const void*>(source), numBytes);
+		return;
 	}
-
-	inline const char* c_str() const {
-		return m_string.c_str();
+#pragma omp parallel
+	{
+		mwSize begin;
+		mwSize end;
+		getThreadRange((numBytes + kPageSize - 1) / kPageSize, begin, end);
+		begin = std::min(begin * kPageSize, numBytes);
+		end = std::min(end * kPageSize, numBytes);
+		if (begin < end) {
+			std::memcpy(static_cast<void*>(
+							reinterpret_cast<char*>(destination) + begin),
+						static_cast<const void*>(
+							reinterpret_cast<const char*>(source) + begin),
+						end - begin);
+		}
 	}
+}
 
-	template <typename IndexType>
-	inline char& operator[](IndexType i) {
-		mexAssert(i < length<IndexType>());
-		return m_string[i];
+template <typename NumericType>
+inline void fillElements(NumericType* destination,
+						const NumericType value,
+						const mwSize numel) {
+	if (numel * sizeof(NumericType) < kParallelCopyThreshold) {
+		std::fill_n(destination, numel, value);
+		return;
 	}
-
-	template <typename IndexType>
-	inline const char* operator[](IndexType i) const {
-		mexAssert(i < length<IndexType>());
-		return m_string[i];
+	const mwSize pageElements = std::max(kPageSize / sizeof(NumericType),
+										size_t(1));
+#pragma omp parallel
+	{
+		mwSize begin;
+		mwSize end;
+		getThreadRange((numel + pageElements - 1) / pageElements, begin, end);
+		begin = std::min(begin * pageElements, numel);
+		end = std::min(end * pageElements, numel);
+		if (begin < end) {
+			std::fill_n(destination + begin, end - begin, value);
+		}
+	}
+}
+
+/*
+ * Edge of the square tiles used when transposing, chosen so that a source and
+ * a destination tile together stay well within L1.
+ */
+constexpr mwSize getPermuteTileEdge(const std::size_t elementSize) {
+	return (elementSize >= 16)
+			? 16
+			: ((elementSize >= 8) ? 32 : ((elementSize >= 4) ? 64 : 128));
+}
+
+/*
+ * Precomputed strides for an out-of-place permutation of a column-major array,
+ * or more generally for gathering a strided array into a contiguous one.
+ * Singleton dimensions are dropped, and output dimensions that are also
+ * adjacent in the source are merged. What remains is either a set of
+ * contiguous runs to copy, or a (batched) 2-D transpose between the first
+ * output dimension and the one with the smallest source stride, which is done
+ * in cache-sized tiles. Work is split between OpenMP threads over the
+ * remaining (outer) dimensions and the tiles.
+ *
+ * The plan can be reused for any number of arrays of the same shape.
+ */
+class PermutePlan {
+public:
+	/*
+	 * Permutation of a contiguous array. The permutation is zero-based.
+	 */
+	PermutePlan(const mwSize numDims, const mwSize* dims,
+				const mwSize* permutation) :
+			m_numel(1),
+			m_extents(),
+			m_sourceStrides(),
+			m_destinationStrides(),
+			m_transposeDim(0),
+			m_outerDims() {
+		std::vector<mwSize> sourceStrides(numDims);
+		for (mwSize iter = 0; iter < numDims; ++iter) {
+			sourceStrides[iter] = m_numel;
+			m_numel *= dims[iter];
+		}
+		for (mwSize iter = 0; iter < numDims; ++iter) {
+			addDimension(dims[permutation[iter]],
+						sourceStrides[permutation[iter]]);
+		}
+		finalize();
+	}
+
+	/*
+	 * Gather of an array with dimensions dims, whose elements are strides
+	 * (in elements) apart in the source.
+	 */
+	PermutePlan(const std::vector<mwSize>& dims,
+				const std::vector<mwSize>& strides) :
+			m_numel(1),
+			m_extents(),
+			m_sourceStrides(),
+			m_destinationStrides(),
+			m_transposeDim(0),
+			m_outerDims() {
+		mexAssert(dims.size() == strides.size());
+		for (mwSize iter = 0, end = dims.size(); iter < end; ++iter) {
+			m_numel *= dims[iter];
+			addDimension(dims[iter], strides[iter]);
+		}
+		finalize();
+	}
+
+	template <typename NumericType>
+	void execute(const NumericType* source, NumericType* destination) const {
+		if (m_numel == 0) {
+			return;
+		}
+		if (m_extents.size() <= 1) {
+			std::memcpy(static_cast<void*>(destination),
+						static_cast<const void*>(source),
+						m_numel * sizeof(NumericType));
+			return;
+		}
+		const mwSize tileEdge = getPermuteTileEdge(sizeof(NumericType));
+		const mwSize numTiles = isContiguous()
+								? 1
+								: (m_extents[m_transposeDim] + tileEdge - 1)
+									/ tileEdge;
+		const mwSize numUnits = m_numel / m_extents[0]
+								/ (isContiguous()
+									? 1
+									: m_extents[m_transposeDim])
+								* numTiles;
+
+#pragma omp parallel if (m_numel >= kParallelThreshold)
+		{
+			mwSize begin;
+			mwSize end;
+			getThreadRange(numUnits, begin, end);
+			if (begin < end) {
+				const mwSize numOuterDims = m_outerDims.size();
+				std::vector<mwSize> subscript(numOuterDims);
+				mwSize outer = begin / numTiles;
+				mwSize tile = begin % numTiles;
+				mwSize sourceOffset = 0;
+				mwSize destinationOffset = 0;
+				for (mwSize iter = 0; iter < numOuterDims; ++iter) {
+					const mwSize dim = m_outerDims[iter];
+					subscript[iter] = outer % m_extents[dim];
+					outer /= m_extents[dim];
+					sourceOffset += subscript[iter] * m_sourceStrides[dim];
+					destinationOffset += subscript[iter]
+										* m_destinationStrides[dim];
+				}
+				for (mwSize unit = begin; unit < end; ++unit) {
+					if (isContiguous()) {
+						std::memcpy(
+							static_cast<void*>(destination + destinationOffset),
+							static_cast<const void*>(source + sourceOffset),
+							m_extents[0] * sizeof(NumericType));
+					} else {
+						transposeTiles(source + sourceOffset,
+									destination + destinationOffset,
+									tile * tileEdge,
+									std::min((tile + 1) * tileEdge,
+											m_extents[m_transposeDim]),
+									tileEdge);
+					}
+					if (++tile < numTiles) {
+						continue;
+					}
+					tile = 0;
+					for (mwSize iter = 0; iter < numOuterDims; ++iter) {
+						const mwSize dim = m_outerDims[iter];
+						sourceOffset += m_sourceStrides[dim];
+						destinationOffset += m_destinationStrides[dim];
+						if (++subscript[iter] < m_extents[dim]) {
+							break;
+						}
+						sourceOffset -= m_extents[dim] * m_sourceStrides[dim];
+						destinationOffset -= m_extents[dim]
+											* m_destinationStrides[dim];
+						subscript[iter] = 0;
+					}
+				}
+			}
+		}
+	}
+
+	inline mwSize getNumberOfElements() const {
+		return m_numel;
+	}
+
+private:
+	static const mwSize kParallelThreshold = 1 << 18;
+
+	inline void addDimension(const mwSize extent, const mwSize stride) {
+		if (extent == 1) {
+			return;
+		}
+		if (!m_extents.empty()
+			&& (m_sourceStrides.back() * m_extents.back() == stride)) {
+			m_extents.back() *= extent;
+		} else {
+			m_destinationStrides.push_back(m_destinationStrides.empty()
+										? 1
+										: m_destinationStrides.back()
+											* m_extents.back());
+			m_extents.push_back(extent);
+			m_sourceStrides.push_back(stride);
+		}
+	}
+
+	inline void finalize() {
+		if (m_extents.empty()) {
+			m_extents.push_back(1);
+			m_sourceStrides.push_back(1);
+			m_destinationStrides.push_back(1);
+		}
+		if ((m_extents.size() == 1) && !isContiguous()) {
+			/*
+			 * A strided vector is handled as a transpose with a single row.
+			 */
+			m_destinationStrides.push_back(m_extents[0]);
+			m_sourceStrides.push_back(m_extents[0] * m_sourceStrides[0]);
+			m_extents.push_back(1);
+		}
+		for (mwSize iter = 1, end = m_extents.size(); iter < end; ++iter) {
+			if ((m_transposeDim == 0)
+				|| (m_sourceStrides[iter] < m_sourceStrides[m_transposeDim])) {
+				m_transposeDim = iter;
+			}
+		}
+		if (isContiguous()) {
+			m_transposeDim = 0;
+		}
+		for (mwSize iter = 1, end = m_extents.size(); iter < end; ++iter) {
+			if (iter != m_transposeDim) {
+				m_outerDims.push_back(iter);
+			}
+		}
+	}
+
+	inline bool isContiguous() const {
+		return (m_sourceStrides[0] == 1);
+	}
+
+	/*
+	 * Transposes rows [rowBegin, rowEnd) of the transpose dimension against
+	 * the whole first dimension, one tileEdge x tileEdge tile at a time.
+	 */
+	template <typename NumericType>
+	inline void transposeTiles(const NumericType* source,
+							NumericType* destination,
+							const mwSize rowBegin,
+							const mwSize rowEnd,
+							const mwSize tileEdge) const {
+		const mwSize numColumns = m_extents[0];
+		const mwSize sourceColumnStride = m_sourceStrides[0];
+		const mwSize sourceRowStride = m_sourceStrides[m_transposeDim];
+		const mwSize destinationRowStride = m_destinationStrides[m_transposeDim];
+		for (mwSize columnBegin = 0; columnBegin < numColumns;
+			columnBegin += tileEdge) {
+			const mwSize columnEnd = std::min(columnBegin + tileEdge, numColumns);
+			for (mwSize row = rowBegin; row < rowEnd; ++row) {
+				const NumericType* sourceRow = source + row * sourceRowStride;
+				NumericType* destinationRow = destination
+											+ row * destinationRowStride;
+				for (mwSize column = columnBegin; column < columnEnd; ++column) {
+					destinationRow[column] = sourceRow[column
+														* sourceColumnStride];
+				}
+			}
+		}
+	}
+
+	mwSize m_numel;
+	std::vector<mwSize> m_extents;
+	std::vector<mwSize> m_sourceStrides;
+	std::vector<mwSize> m_destinationStrides;
+	mwSize m_transposeDim;
+	std::vector<mwSize> m_outerDims;
+};
+
+/*
+ * Fixed-size array whose first kInlineSize elements live in the object, so
+ * that small arrays (in practice, per-dimension data of arrays with few
+ * dimensions) do not allocate. Larger sizes fall back to heap storage.
+ */
+template <typename T, mwSize kInlineSize>
+class InlineArray {
+public:
+	explicit InlineArray(const mwSize size = 0) :
+			m_size(size),
+			m_inline(),
+			m_heap((size > kInlineSize) ? size : 0) {}
+
+	inline T& operator[](const mwSize index) {
+		mexAssert(index < m_size);
+		return (m_size > kInlineSize) ? m_heap[index] : m_inline[index];
+	}
+
+	inline const T& operator[](const mwSize index) const {
+		mexAssert(index < m_size);
+		return (m_size > kInlineSize) ? m_heap[index] : m_inline[index];
+	}
+
+	inline T* data() {
+		return (m_size > kInlineSize) ? m_heap.data() : m_inline.data();
+	}
+
+	inline const T* data() const {
+		return (m_size > kInlineSize) ? m_heap.data() : m_inline.data();
+	}
+
+	inline mwSize size() const {
+		return m_size;
+	}
+
+private:
+	mwSize m_size;
+	std::array<T, kInlineSize> m_inline;
+	std::vector<T> m_heap;
+};
+
+}  // namespace detail
+
+/*
+ * Conversion between column-major linear indices and subscripts for a fixed
+ * shape. Dimensions and strides are read once on construction and stored
+ * inline (heap storage is used only past kInlineDimensions), so that
+ * conversions do not allocate or call into MATLAB, and divisions are replaced
+ * by detail::FastDivisor.
+ * Indices and subscripts are zero-based, unless the batch conversions are
+ * given a different base (for example 1, for find results).
+ */
+class IndexCalculator {
+public:
+	static const mwSize kInlineDimensions = 32;
+
+	template <typename IndexType>
+	IndexCalculator(const IndexType numDims, const IndexType* dims) :
+			m_numberOfDimensions(static_cast<mwSize>(numDims)),
+			m_numberOfElements(1),
+			m_dimensions(m_numberOfDimensions),
+			m_strides(m_numberOfDimensions),
+			m_divisors(m_numberOfDimensions) {
+		for (mwSize iter = 0; iter < m_numberOfDimensions; ++iter) {
+			m_dimensions[iter] = static_cast<mwSize>(dims[iter]);
+			m_strides[iter] = m_numberOfElements;
+			m_divisors[iter] = detail::FastDivisor(std::max(m_dimensions[iter],
+															mwSize(1)));
+			m_numberOfElements *= m_dimensions[iter];
+		}
+	}
+
+	explicit IndexCalculator(const MxArray& array) :
+			IndexCalculator(array.getNumberOfDimensions<mwSize>(),
+							mxGetDimensions(array.get_array())) {}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfDimensions() const {
+		return static_cast<IndexType>(m_numberOfDimensions);
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfElements() const {
+		return static_cast<IndexType>(m_numberOfElements);
+	}
+
+	template <typename IndexType>
+	inline IndexType getStride(const IndexType dim) const {
+		return static_cast<IndexType>(m_strides[static_cast<mwSize>(dim)]);
+	}
+
+	/*
+	 * subscript must have room for getNumberOfDimensions() entries.
+	 */
+	template <typename IndexType>
+	inline void ind2sub(const IndexType index, IndexType* subscript) const {
+		mexAssert(static_cast<mwSize>(index) < m_numberOfElements);
+		mwSize remainder = static_cast<mwSize>(index);
+		for (mwSize iter = 0; iter + 1 < m_numberOfDimensions; ++iter) {
+			const mwSize quotient = m_divisors[iter].divide(remainder);
+			subscript[iter] = static_cast<IndexType>(remainder
+											- quotient * m_dimensions[iter]);
+			remainder = quotient;
+		}
+		if (m_numberOfDimensions > 0) {
+			subscript[m_numberOfDimensions - 1] =
+											static_cast<IndexType>(remainder);
+		}
+	}
+
+	template <typename IndexType>
+	inline IndexType sub2ind(const IndexType* subscript) const {
+		mwSize index = 0;
+		for (mwSize iter = 0; iter < m_numberOfDimensions; ++iter) {
+			mexAssert(static_cast<mwSize>(subscript[iter])
+					< m_dimensions[iter]);
+			index += static_cast<mwSize>(subscript[iter]) * m_strides[iter];
+		}
+		return static_cast<IndexType>(index);
+	}
+
+	/*
+	 * Batch versions. Subscripts are stored one dimension after the other,
+	 * that is as a numIndices x getNumberOfDimensions() column-major matrix,
+	 * which is the layout of [I, J, K, ...] in MATLAB. The input and output
+	 * types may differ (for example double indices from find and mwIndex
+	 * subscripts), and base is subtracted from inputs and added to outputs.
+	 * Inputs are not range-checked.
+	 */
+	template <typename IndexType, typename SubscriptType>
+	void ind2sub(const IndexType* indices, const mwSize numIndices,
+				SubscriptType* subscripts, const mwSize base = 0) const {
+		const mwSize numDims = m_numberOfDimensions;
+#pragma omp parallel for if (numIndices >= kParallelThreshold)
+		for (mwSize iterIndex = 0; iterIndex < numIndices; ++iterIndex) {
+			mwSize remainder = static_cast<mwSize>(indices[iterIndex]) - base;
+			for (mwSize iter = 0; iter + 1 < numDims; ++iter) {
+				const mwSize quotient = m_divisors[iter].divide(remainder);
+				subscripts[iter * numIndices + iterIndex] =
+						static_cast<SubscriptType>(remainder
+										- quotient * m_dimensions[iter] + base);
+				remainder = quotient;
+			}
+			if (numDims > 0) {
+				subscripts[(numDims - 1) * numIndices + iterIndex] =
+									static_cast<SubscriptType>(remainder + base);
+			}
+		}
+	}
+
+	template <typename SubscriptType, typename IndexType>
+	void sub2ind(const SubscriptType* subscripts, const mwSize numIndices,
+				IndexType* indices, const mwSize base = 0) const {
+		const mwSize numDims = m_numberOfDimensions;
+		const mwSize offset = base * std::accumulate(m_strides.data(),
+													m_strides.data() + numDims,
+													mwSize(0));
+#pragma omp parallel for if (numIndices >= kParallelThreshold)
+		for (mwSize iterIndex = 0; iterIndex < numIndices; ++iterIndex) {
+			mwSize index = 0;
+			for (mwSize iter = 0; iter < numDims; ++iter) {
+				index += static_cast<mwSize>(
+									subscripts[iter * numIndices + iterIndex])
+						* m_strides[iter];
+			}
+			indices[iterIndex] = static_cast<IndexType>(index - offset + base);
+		}
+	}
+
+private:
+	static const mwSize kParallelThreshold = 1 << 16;
+
+	mwSize m_numberOfDimensions;
+	mwSize m_numberOfElements;
+	detail::InlineArray<mwSize, kInlineDimensions> m_dimensions;
+	detail::InlineArray<mwSize, kInlineDimensions> m_strides;
+	detail::InlineArray<detail::FastDivisor, kInlineDimensions> m_divisors;
+};
+
+namespace detail {
+
+/*
+ * Buffer that the next MxAllocator::deallocate on this thread must not free,
+ * because an MxNumeric has adopted it.
+ */
+inline void*& getReleasedBuffer() {
+	static thread_local void* releasedBuffer = nullptr;
+	return releasedBuffer;
+}
+
+}  // namespace detail
+
+/*
+ * STL allocator over mxMalloc and mxFree, so that a std::vector (MxVector) can
+ * be handed to an MxNumeric without copying. Like any mxMalloc memory, buffers
+ * are freed by MATLAB when the mex function returns unless adopted by an
+ * array returned to MATLAB, and must only be allocated from the MATLAB thread.
+ */
+template <typename T>
+class MxAllocator {
+public:
+	using value_type = T;
+
+	MxAllocator() = default;
+
+	template <typename U>
+	MxAllocator(const MxAllocator<U>& /* other */) {}
+
+	inline T* allocate(const std::size_t n) {
+		return static_cast<T*>(mxMalloc(n * sizeof(T)));
+	}
+
+	inline void deallocate(T* p, const std::size_t /* n */) {
+		if (static_cast<void*>(p) == detail::getReleasedBuffer()) {
+			detail::getReleasedBuffer() = nullptr;
+			return;
+		}
+		mxFree(static_cast<void*>(p));
+	}
+};
+
+template <typename T, typename U>
+inline bool operator==(const MxAllocator<T>& /* first */,
+					const MxAllocator<U>& /* second */) {
+	return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const MxAllocator<T>& /* first */,
+					const MxAllocator<U>& /* second */) {
+	return false;
+}
+
+template <typename NumericType>
+using MxVector = std::vector<NumericType, MxAllocator<NumericType> >;
+
+/*
+ * Tag for constructors that leave the data uninitialized, for arrays whose
+ * every element is written next. Skipping the zero-fill saves a full pass over
+ * memory. Uses mxCreateUninitNumericArray, unless MEX_UTILS_NO_UNINIT_ARRAYS
+ * is defined for MATLAB releases without it (before R2015a).
+ */
+struct UninitializedTag {};
+constexpr UninitializedTag kUninitialized = UninitializedTag();
+
+/*
+ * Tag for constructors that copy or fill in parallel (see
+ * detail::copyElements). The new array is created uninitialized, so that its
+ * pages are first touched by the threads doing the copy.
+ */
+struct ParallelTag {};
+constexpr ParallelTag kParallel = ParallelTag();
+
+namespace detail {
+
+inline PMxArrayNative createNumericArray(const mwSize numDims,
+										const mwSize* dims,
+										const mxClassID classId,
+										const bool isInitialized,
+										const mxComplexity complexity = mxREAL) {
+#ifndef MEX_UTILS_NO_UNINIT_ARRAYS
+	if (!isInitialized) {
+		return mxCreateUninitNumericArray(numDims, const_cast<mwSize*>(dims),
+										classId, complexity);
+	}
+#endif
+	return mxCreateNumericArray(numDims, dims, classId, complexity);
+}
+
+}  // namespace detail
+
+/*
+ * Lightweight handle to the data of a numeric array. The data pointer and
+ * shape are read once, on construction, so that element access is a plain
+ * pointer index that the compiler can inline and vectorize, unlike
+ * MxNumeric::operator[], which calls into MATLAB every time. The handle does
+ * not own the data, and must not outlive the array, or be used after the
+ * array's data is replaced. Accessors of const NumericType are read-only.
+ */
+template <typename NumericType>
+class MxNumericAccessor {
+public:
+	typedef typename std::remove_const<NumericType>::type ValueType;
+
+	MxNumericAccessor() :
+			m_data(nullptr),
+			m_numberOfElements(0),
+			m_numberOfRows(0) {}
+	MxNumericAccessor(const MxNumericAccessor<NumericType>& other) = default;
+	MxNumericAccessor<NumericType>& operator=(
+						const MxNumericAccessor<NumericType>& other) = default;
+
+	explicit MxNumericAccessor(const MxArray& array) :
+			m_data(static_cast<NumericType*>(mxGetData(array.get_array()))),
+			m_numberOfElements(array.getNumberOfElements<mwSize>()),
+			m_numberOfRows(array.getNumberOfRows<mwSize>()) {
+		mexAssert(detail::isNumericClass<ValueType>(array.get_array()));
+	}
+
+	template <typename IndexType>
+	inline NumericType& operator[](IndexType i) const {
+		mexAssert(static_cast<mwSize>(i) < m_numberOfElements);
+		return m_data[i];
+	}
+
+	template <typename IndexType>
+	inline NumericType& operator()(IndexType row, IndexType column) const {
+		mexAssert(static_cast<mwSize>(row) < m_numberOfRows);
+		mexAssert(static_cast<mwSize>(row)
+				+ static_cast<mwSize>(column) * m_numberOfRows
+				< m_numberOfElements);
+		return m_data[static_cast<mwSize>(row)
+					+ static_cast<mwSize>(column) * m_numberOfRows];
+	}
+
+	inline NumericType* getData() const {
+		return m_data;
+	}
+
+	inline NumericType* begin() const {
+		return m_data;
+	}
+
+	inline NumericType* end() const {
+		return m_data + m_numberOfElements;
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfElements() const {
+		return static_cast<IndexType>(m_numberOfElements);
+	}
+
+	inline int getNumberOfElements() const {
+		return getNumberOfElements<int>();
+	}
+
+	template <typename IndexType>
+	inline IndexType size() const {
+		return getNumberOfElements<IndexType>();
+	}
+
+	inline int size() const {
+		return size<int>();
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfRows() const {
+		return static_cast<IndexType>(m_numberOfRows);
+	}
+
+	inline int getNumberOfRows() const {
+		return getNumberOfRows<int>();
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfColumns() const {
+		return static_cast<IndexType>((m_numberOfRows == 0)
+									? 0
+									: m_numberOfElements / m_numberOfRows);
+	}
+
+	inline int getNumberOfColumns() const {
+		return getNumberOfColumns<int>();
+	}
+
+private:
+	NumericType* m_data;
+	mwSize m_numberOfElements;
+	mwSize m_numberOfRows;
+};
+
+template <typename NumericType>
+class MxNumeric : public MxArray {
+public:
+	MxNumeric() = default;
+	MxNumeric(const MxNumeric<NumericType>& other) = default;
+	MxNumeric<NumericType>& operator=(const MxNumeric<NumericType>& other)
+																	= default;
+	MxNumeric(MxNumeric<NumericType>&& other) = default;
+	MxNumeric<NumericType>& operator=(MxNumeric<NumericType>&& other) = default;
+
+	explicit MxNumeric(const detail::PMxArrayNative array) :
+			MxArray(array) {
+		mexAssert(detail::isNumericClass<NumericType>(array));
+		mexAssertEx(!mxIsSparse(array), "Use MxSparse for sparse arrays");
+	}
+
+	/*
+	 * TODO: Find way to avoid the dims cast when mwSize IndexType is used.
+	 */
+	template <typename IndexType>
+	MxNumeric(const NumericType* arrVar,
+			const IndexType numDims,
+			const IndexType *dims) :
+			MxNumeric(detail::createNumericArray(static_cast<mwSize>(numDims),
+										std::vector<mwSize>(dims,
+															dims + numDims)
+															.data(),
+										MxNumericClass<NumericType>::m_classId,
+										arrVar == nullptr,
+										MxNumericClass<NumericType>::m_complexity)) {
+		if (arrVar != nullptr) {
+			NumericType *val = static_cast<NumericType*>(mxGetData(
+																get_array()));
+			std::memcpy(static_cast<void*>(val),
+						static_cast<const void*>(arrVar),
+						getNumberOfElements<size_t>() * sizeof(NumericType));
+		}
+	}
+
+	template <typename IndexType>
+	MxNumeric(UninitializedTag /* tag */, const IndexType numDims,
+			const IndexType *dims) :
+			MxNumeric(detail::createNumericArray(static_cast<mwSize>(numDims),
+										std::vector<mwSize>(dims,
+															dims + numDims)
+															.data(),
+										MxNumericClass<NumericType>::m_classId,
+										false,
+										MxNumericClass<NumericType>::m_complexity)) {}
+
+	template <typename IndexType>
+	MxNumeric(UninitializedTag tag, const IndexType numRows,
+			const IndexType numColumns) :
+			MxNumeric(tag, static_cast<mwSize>(2),
+					detail::array2D{static_cast<mwSize>(numRows),
+									static_cast<mwSize>(numColumns)}.data()) {}
+
+	template <typename IndexType>
+	MxNumeric(UninitializedTag tag, const std::vector<IndexType>& dims) :
+			MxNumeric(tag, static_cast<IndexType>(dims.size()), dims.data()) {}
+
+	/*
+	 * As the corresponding constructors without the tag, but the copy (or
+	 * zero-fill if arrVar is nullptr) is done in parallel.
+	 */
+	template <typename IndexType>
+	MxNumeric(ParallelTag /* tag */, const NumericType* arrVar,
+			const IndexType numDims, const IndexType *dims) :
+			MxNumeric(kUninitialized, numDims, dims) {
+		if (arrVar != nullptr) {
+			copyFrom(arrVar);
+		} else {
+			fill(NumericType());
+		}
+	}
+
+	template <typename IndexType>
+	MxNumeric(ParallelTag tag, const IndexType numDims, const IndexType *dims) :
+			MxNumeric(tag, nullptr, numDims, dims) {}
+
+	template <typename IndexType>
+	MxNumeric(ParallelTag tag, const NumericType* arrVar,
+			const std::vector<IndexType>& dims) :
+			MxNumeric(tag, arrVar, dims.size(), dims.data()) {}
+
+	MxNumeric(ParallelTag tag, const std::vector<NumericType>& vecVar) :
+			MxNumeric(tag, vecVar.data(), static_cast<mwSize>(2),
+					detail::array2D{vecVar.size(), 1}.data()) {}
+
+	template <typename IndexType>
+	MxNumeric(const IndexType numDims, const IndexType *dims) :
+			MxNumeric(nullptr, numDims, dims) {}
+
+	template <typename IndexType>
+	MxNumeric(const IndexType numRows, const IndexType numColumns) :
+			MxNumeric(nullptr, static_cast<mwSize>(2),
+					detail::array2D{numRows, numColumns}.data()) {}
+
+	template <typename IndexType>
+	MxNumeric(const NumericType* arrVar, const IndexType numRows,
+			const IndexType numColumns) :
+			MxNumeric(arrVar, static_cast<mwSize>(2),
+					detail::array2D{numRows, numColumns}.data()) {}
+
+	explicit MxNumeric(const std::vector<NumericType>& vecVar) :
+			MxNumeric(vecVar.data(), static_cast<mwSize>(2),
+					detail::array2D{vecVar.size(), 1}.data()) {}
+
+	template <std::size_t ArraySize>
+	explicit MxNumeric(const std::array<NumericType, ArraySize>& arrVar) :
+			MxNumeric(arrVar.data(), static_cast<mwSize>(2),
+					detail::array2D{ArraySize, 1}.data()) {}
+
+	explicit MxNumeric(const NumericType scalarVar) :
+			MxNumeric(&scalarVar, static_cast<mwSize>(2),
+					detail::array2D{1, 1}.data()) {}
+
+	template <typename IndexType>
+	MxNumeric(const NumericType* arrVar, const std::vector<IndexType>& dims) :
+			MxNumeric(arrVar, dims.size(), dims.data()) {}
+
+	/*
+	 * Adopt the buffer of an MxVector through mxSetData, without copying.
+	 * vecVar is left empty.
+	 */
+	explicit MxNumeric(MxVector<NumericType>&& vecVar) :
+			MxNumeric(std::move(vecVar),
+					std::vector<mwSize>{vecVar.size(), 1}) {}
+
+	template <typename IndexType>
+	MxNumeric(MxVector<NumericType>&& vecVar,
+			const std::vector<IndexType>& dims) :
+			MxNumeric(mxCreateNumericMatrix(0, 0,
+									MxNumericClass<NumericType>::m_classId,
+									MxNumericClass<NumericType>::m_complexity)) {
+		static_assert(!std::is_same<NumericType, bool>::value,
+					"std::vector<bool> is not stored as an array of bool.");
+		const std::vector<mwSize> dimensions(dims.begin(), dims.end());
+		mexAssert(std::accumulate(dimensions.begin(), dimensions.end(),
+								mwSize(1), std::multiplies<mwSize>())
+				== vecVar.size());
+		if (!vecVar.empty()) {
+			mxSetData(get_array(), static_cast<void*>(vecVar.data()));
+			detail::getReleasedBuffer() = static_cast<void*>(vecVar.data());
+			MxVector<NumericType>(vecVar.get_allocator()).swap(vecVar);
+		}
+		mxSetDimensions(get_array(), dimensions.data(), dimensions.size());
+	}
+
+	template <typename IndexType>
+	inline NumericType& operator[](IndexType i) {
+		mexAssert(i < getNumberOfElements<IndexType>());
+		NumericType* temp = static_cast<NumericType*>(mxGetData(get_array()));
+		return temp[i];
+	}
+
+	template <typename IndexType>
+	inline const NumericType& operator[](IndexType i) const {
+		mexAssert(i < getNumberOfElements<IndexType>());
+		NumericType* temp = static_cast<NumericType*>(mxGetData(get_array()));
+		return temp[i];
+	}
+
+	inline const NumericType* getData() const {
+		return static_cast<const NumericType*>(mxGetData(get_array()));
+	}
+
+	inline NumericType* getData() {
+		return static_cast<NumericType*>(mxGetData(get_array()));
+	}
+
+	/*
+	 * Iterators are plain pointers into the MATLAB data, so STL algorithms
+	 * work in place.
+	 */
+	using iterator = NumericType*;
+	using const_iterator = const NumericType*;
+
+	inline iterator begin() {
+		return getData();
+	}
+
+	inline iterator end() {
+		return getData() + getNumberOfElements<size_t>();
+	}
+
+	inline const_iterator begin() const {
+		return getData();
+	}
+
+	inline const_iterator end() const {
+		return getData() + getNumberOfElements<size_t>();
+	}
+
+	inline const_iterator cbegin() const {
+		return begin();
+	}
+
+	inline const_iterator cend() const {
+		return end();
+	}
+
+	/*
+	 * Overwrite all elements, in parallel for large arrays. source must hold
+	 * getNumberOfElements() elements.
+	 */
+	inline void copyFrom(const NumericType* source) {
+		detail::copyElements(getData(), source,
+							getNumberOfElements<mwSize>());
+	}
+
+	inline void copyFrom(const std::vector<NumericType>& vecVar) {
+		mexAssert(vecVar.size() == getNumberOfElements<size_t>());
+		copyFrom(vecVar.data());
+	}
+
+	inline void fill(const NumericType value) {
+		detail::fillElements(getData(), value, getNumberOfElements<mwSize>());
+	}
+
+	/*
+	 * For inner loops, use an accessor instead of operator[].
+	 */
+	inline MxNumericAccessor<const NumericType> getAccessor() const {
+		return MxNumericAccessor<const NumericType>(*this);
+	}
+
+	inline MxNumericAccessor<NumericType> getAccessor() {
+		return MxNumericAccessor<NumericType>(*this);
+	}
+
+	inline std::vector<NumericType> vectorize() const {
+		int numel = getNumberOfElements();
+		const NumericType* pData = getData();
+		return std::vector<NumericType>(pData, pData + numel);
+	}
+
+	/*
+	 * For repeated or batch conversions, use an IndexCalculator directly.
+	 */
+	template <typename IndexType>
+	inline std::vector<IndexType> ind2sub(IndexType index) const {
+		const IndexCalculator calculator(*this);
+		std::vector<IndexType> subscript(
+								calculator.getNumberOfDimensions<size_t>());
+		calculator.ind2sub(index, subscript.data());
+		return subscript;
+	}
+
+	template <typename IndexType>
+	inline IndexType sub2ind(const std::vector<IndexType>& subscript) const {
+		const IndexCalculator calculator(*this);
+		mexAssert(subscript.size()
+				== calculator.getNumberOfDimensions<size_t>());
+		return calculator.sub2ind(subscript.data());
+	}
+
+	/*
+	 * Out-of-place multidimensional permute, with the same (one-based)
+	 * semantics as MATLAB's permute. See detail::PermutePlan.
+	 */
+	template <typename IndexType>
+	MxNumeric<NumericType> permute(
+								const std::vector<IndexType>& indexPermutation)
+								const {
+		mexAssert(isIndexPermutation(indexPermutation));
+		const std::vector<IndexType> dimensions = getDimensions<IndexType>();
+		const std::vector<IndexType> permutedDimensions = permuteIndexVector(
+															dimensions,
+															indexPermutation);
+		MxNumeric<NumericType> retArg(kUninitialized,
+									static_cast<IndexType>(
+													permutedDimensions.size()),
+									&permutedDimensions[0]);
+		const std::vector<mwSize> sourceDimensions = getDimensions<mwSize>();
+		std::vector<mwSize> permutation(indexPermutation.size());
+		for (size_t iter = 0, end = permutation.size(); iter < end; ++iter) {
+			permutation[iter] = static_cast<mwSize>(indexPermutation[iter] - 1);
+		}
+		detail::PermutePlan(sourceDimensions.size(),
+							sourceDimensions.data(),
+							permutation.data()).execute(getData(),
+														retArg.getData());
+		return retArg;
+	}
+
+	virtual ~MxNumeric() = default;
+
+private:
+	template <typename IndexType>
+	inline bool isIndexPermutation(
+								const std::vector<IndexType>& indexPermutation)
+								const {
+		if (indexPermutation.size() != getNumberOfDimensions<size_t>()) {
+			return false;
+		}
+		std::vector<IndexType> indexVector;
+		for (IndexType iter = 0,
+			end = getNumberOfDimensions<IndexType>();
+			iter < end;
+			++iter) {
+			indexVector.push_back(iter + 1);
+		}
+		typename std::vector<IndexType>::const_iterator first(
+													indexPermutation.begin());
+		typename std::vector<IndexType>::const_iterator last(
+													indexPermutation.end());
+		typename std::vector<IndexType>::iterator d_first(indexVector.begin());
+		if (first != last) {
+			typename std::vector<IndexType>::iterator d_last = d_first;
+			std::advance(d_last, std::distance(first, last));
+			for (typename std::vector<IndexType>::const_iterator i = first;
+				i != last;
+				++i) {
+				if (i != std::find(first, i, *i)) {
+					continue;  // already counted this *i
+				}
+
+				IndexType m = std::count(d_first, d_last, *i);
+				if (m == 0 || std::count(i, last, *i) != m) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	template <typename IndexType>
+	inline std::vector<IndexType> permuteIndexVector(
+							const std::vector<IndexType>& indexVector,
+							const std::vector<IndexType>& indexPermutation)
+							const {
+		std::vector<IndexType> permutedIndexVector(indexVector.size(), 0);
+		for (IndexType iter = 0, end = indexVector.size(); iter < end; ++iter) {
+			permutedIndexVector[iter] = indexVector[indexPermutation[iter] - 1];
+		}
+		return permutedIndexVector;
+	}
+};
+
+template <>
+inline MxNumeric<bool>::MxNumeric(const std::vector<bool>& vecVar) :
+		MxNumeric(kUninitialized, static_cast<mwSize>(2),
+				detail::array2D{vecVar.size(), 1}.data()) {
+	bool* dataArray = getData();
+	int index = 0;
+	for (auto iter = std::begin(vecVar); iter < std::end(vecVar); ++iter) {
+		dataArray[index++] = *iter;
+	}
+}
+
+template <> template <std::size_t ArraySize>
+inline MxNumeric<bool>::MxNumeric(const std::array<bool, ArraySize>& arrVar) :
+		MxNumeric(kUninitialized, static_cast<mwSize>(2),
+				detail::array2D{ArraySize, 1}.data()) {
+	bool* dataArray = getData();
+	int index = 0;
+	for (auto iter = std::begin(arrVar); iter < std::end(arrVar); ++iter) {
+		dataArray[index++] = *iter;
+	}
+}
+
+#if defined(MX_HAS_INTERLEAVED_COMPLEX) && MX_HAS_INTERLEAVED_COMPLEX
+template <typename NumericType>
+using MxComplex = MxNumeric<std::complex<NumericType> >;
+#endif
+
+/*
+ * Non-owning strided view of the data of an MxNumeric. Permuting, transposing,
+ * slicing, and (when strides allow) reshaping produce new views without
+ * touching the data. Like MxArray, copies are shallow, and the viewed array
+ * must outlive the view, and its iterators, which copy the shape of the view
+ * and so do not depend on it. Views of const arrays are of const NumericType.
+ * Dimensions and indices are zero-based, except for permute, which follows
+ * MATLAB's one-based convention as MxNumeric::permute does. materialize()
+ * copies the viewed elements into a new contiguous MxNumeric, for example to
+ * hand back to MATLAB.
+ */
+template <typename NumericType>
+class MxNumericView {
+public:
+	typedef typename std::remove_const<NumericType>::type ValueType;
+	typedef typename std::conditional<std::is_const<NumericType>::value,
+									const MxNumeric<ValueType>,
+									MxNumeric<ValueType> >::type ArrayType;
+
+	class iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = ValueType;
+		using difference_type = std::ptrdiff_t;
+		using pointer = NumericType*;
+		using reference = NumericType&;
+
+		iterator() :
+				m_data(nullptr),
+				m_axes(),
+				m_position(0),
+				m_offset(0) {}
+
+		explicit iterator(const MxNumericView<NumericType>& view) :
+				m_data(view.m_data),
+				m_axes(view.m_dimensions.size()),
+				m_position(0),
+				m_offset(0) {
+			for (mwSize iter = 0, end = m_axes.size(); iter < end; ++iter) {
+				m_axes[iter] = Axis{view.m_dimensions[iter],
+									view.m_strides[iter], 0};
+			}
+		}
+
+		/*
+		 * Position-only sentinel, which compares equal to an iterator that
+		 * has been advanced position times, but which cannot itself be
+		 * dereferenced or advanced.
+		 */
+		explicit iterator(const mwSize position) :
+				m_data(nullptr),
+				m_axes(),
+				m_position(position),
+				m_offset(0) {}
+
+		inline NumericType& operator*() const {
+			return m_data[m_offset];
+		}
+
+		inline NumericType* operator->() const {
+			return &m_data[m_offset];
+		}
+
+		inline iterator& operator++() {
+			++m_position;
+			for (mwSize iter = 0, end = m_axes.size(); iter < end; ++iter) {
+				Axis& axis = m_axes[iter];
+				m_offset += axis.m_stride;
+				if (++axis.m_subscript < axis.m_dimension) {
+					break;
+				}
+				m_offset -= axis.m_dimension * axis.m_stride;
+				axis.m_subscript = 0;
+			}
+			return *this;
+		}
+
+		inline iterator operator++(int) {
+			iterator retArg(*this);
+			++(*this);
+			return retArg;
+		}
+
+		inline bool operator==(const iterator& other) const {
+			return (m_position == other.m_position);
+		}
+
+		inline bool operator!=(const iterator& other) const {
+			return (m_position != other.m_position);
+		}
+
+	private:
+		struct Axis {
+			mwSize m_dimension;
+			mwSize m_stride;
+			mwSize m_subscript;
+		};
+
+		using AxisArray = detail::InlineArray<Axis,
+										IndexCalculator::kInlineDimensions>;
+
+		NumericType* m_data;
+		AxisArray m_axes;
+		mwSize m_position;
+		mwSize m_offset;
+	};
+
+	MxNumericView() :
+			m_data(nullptr),
+			m_dimensions(),
+			m_strides() {}
+
+	MxNumericView(const MxNumericView<NumericType>& other) = default;
+	MxNumericView<NumericType>& operator=(
+							const MxNumericView<NumericType>& other) = default;
+	MxNumericView(MxNumericView<NumericType>&& other) = default;
+	MxNumericView<NumericType>& operator=(
+							MxNumericView<NumericType>&& other) = default;
+
+	explicit MxNumericView(ArrayType& array) :
+			m_data(static_cast<NumericType*>(mxGetData(array.get_array()))),
+			m_dimensions(array.template getDimensions<mwSize>()),
+			m_strides(m_dimensions.size()) {
+		mwSize stride = 1;
+		for (mwSize iter = 0, end = m_dimensions.size(); iter < end; ++iter) {
+			m_strides[iter] = stride;
+			stride *= m_dimensions[iter];
+		}
+	}
+
+	MxNumericView(NumericType* data, const std::vector<mwSize>& dims,
+				const std::vector<mwSize>& strides) :
+			m_data(data),
+			m_dimensions(dims),
+			m_strides(strides) {
+		mexAssert(m_dimensions.size() == m_strides.size());
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfDimensions() const {
+		return static_cast<IndexType>(m_dimensions.size());
+	}
+
+	inline int getNumberOfDimensions() const {
+		return getNumberOfDimensions<int>();
+	}
+
+	template <typename IndexType>
+	inline std::vector<IndexType> getDimensions() const {
+		return std::vector<IndexType>(m_dimensions.begin(), m_dimensions.end());
+	}
+
+	inline std::vector<int> getDimensions() const {
+		return getDimensions<int>();
+	}
+
+	inline const std::vector<mwSize>& getStrides() const {
+		return m_strides;
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfElements() const {
+		mwSize numel = 1;
+		for (mwSize iter = 0, end = m_dimensions.size(); iter < end; ++iter) {
+			numel *= m_dimensions[iter];
+		}
+		return static_cast<IndexType>(numel);
+	}
+
+	inline int getNumberOfElements() const {
+		return getNumberOfElements<int>();
+	}
+
+	template <typename IndexType>
+	inline IndexType size() const {
+		return getNumberOfElements<IndexType>();
+	}
+
+	inline int size() const {
+		return size<int>();
+	}
+
+	inline NumericType* getData() const {
+		return m_data;
+	}
+
+	/*
+	 * Whether the view covers a column-major block of memory with no gaps.
+	 */
+	inline bool isContiguous() const {
+		mwSize stride = 1;
+		for (mwSize iter = 0, end = m_dimensions.size(); iter < end; ++iter) {
+			if ((m_dimensions[iter] != 1) && (m_strides[iter] != stride)) {
+				return false;
+			}
+			stride *= m_dimensions[iter];
+		}
+		return true;
+	}
+
+	/*
+	 * Access by column-major linear index into the view's own shape.
+	 */
+	template <typename IndexType>
+	inline NumericType& operator[](IndexType i) const {
+		mexAssert(i < getNumberOfElements<IndexType>());
+		mwSize index = static_cast<mwSize>(i);
+		mwSize offset = 0;
+		for (mwSize iter = 0, end = m_dimensions.size(); iter < end; ++iter) {
+			offset += (index % m_dimensions[iter]) * m_strides[iter];
+			index /= m_dimensions[iter];
+		}
+		return m_data[offset];
+	}
+
+	template <typename IndexType>
+	inline NumericType& operator()(const std::vector<IndexType>& subscript)
+								const {
+		mexAssert(subscript.size() == m_dimensions.size());
+		mwSize offset = 0;
+		for (mwSize iter = 0, end = m_dimensions.size(); iter < end; ++iter) {
+			mexAssert(static_cast<mwSize>(subscript[iter])
+					< m_dimensions[iter]);
+			offset += static_cast<mwSize>(subscript[iter]) * m_strides[iter];
+		}
+		return m_data[offset];
+	}
+
+	template <typename IndexType>
+	inline NumericType& operator()(IndexType row, IndexType column) const {
+		mexAssert(m_dimensions.size() == 2);
+		mexAssert((static_cast<mwSize>(row) < m_dimensions[0])
+				&& (static_cast<mwSize>(column) < m_dimensions[1]));
+		return m_data[static_cast<mwSize>(row) * m_strides[0]
+					+ static_cast<mwSize>(column) * m_strides[1]];
+	}
+
+	inline iterator begin() const {
+		return iterator(*this);
+	}
+
+	inline iterator end() const {
+		return iterator(getNumberOfElements<mwSize>());
+	}
+
+	template <typename IndexType>
+	inline MxNumericView<NumericType> permute(
+								const std::vector<IndexType>& indexPermutation)
+								const {
+		mexAssert(indexPermutation.size() == m_dimensions.size());
+		std::vector<mwSize> dims(m_dimensions.size());
+		std::vector<mwSize> strides(m_dimensions.size());
+		std::vector<bool> isUsed(m_dimensions.size(), false);
+		for (mwSize iter = 0, end = m_dimensions.size(); iter < end; ++iter) {
+			const mwSize dim = static_cast<mwSize>(indexPermutation[iter] - 1);
+			mexAssertEx((dim < end) && !isUsed[dim], "Invalid permutation");
+			isUsed[dim] = true;
+			dims[iter] = m_dimensions[dim];
+			strides[iter] = m_strides[dim];
+		}
+		return MxNumericView<NumericType>(m_data, dims, strides);
+	}
+
+	inline MxNumericView<NumericType> transpose() const {
+		mexAssert(m_dimensions.size() == 2);
+		return permute(std::vector<mwSize>{2, 1});
+	}
+
+	/*
+	 * Restricts dimension dim to the count indices begin, begin + step, ...
+	 */
+	template <typename IndexType>
+	inline MxNumericView<NumericType> slice(const IndexType dim,
+										const IndexType begin,
+										const IndexType count,
+										const IndexType step = 1) const {
+		const mwSize sliceDim = static_cast<mwSize>(dim);
+		mexAssert(sliceDim < m_dimensions.size());
+		mexAssert(step > 0);
+		mexAssert((count == 0)
+				|| (static_cast<mwSize>(begin + (count - 1) * step)
+					< m_dimensions[sliceDim]));
+		std::vector<mwSize> dims(m_dimensions);
+		std::vector<mwSize> strides(m_strides);
+		dims[sliceDim] = static_cast<mwSize>(count);
+		strides[sliceDim] *= static_cast<mwSize>(step);
+		return MxNumericView<NumericType>(
+								m_data + static_cast<mwSize>(begin)
+										* m_strides[sliceDim],
+								dims, strides);
+	}
+
+	/*
+	 * Fails if the new dimensions cannot be expressed with strides over the
+	 * same data, which is never the case for contiguous views.
+	 */
+	template <typename IndexType>
+	inline MxNumericView<NumericType> reshape(
+										const std::vector<IndexType>& dims)
+										const {
+		std::vector<mwSize> newDims(dims.begin(), dims.end());
+		std::vector<mwSize> newStrides(newDims.size(), 1);
+		mwSize numel = 1;
+		for (mwSize iter = 0, end = newDims.size(); iter < end; ++iter) {
+			numel *= newDims[iter];
+		}
+		mexAssertEx(numel == getNumberOfElements<mwSize>(),
+					"Number of elements must not change");
+		if (numel == 0) {
+			for (mwSize iter = 1, end = newDims.size(); iter < end; ++iter) {
+				newStrides[iter] = newStrides[iter - 1] * newDims[iter - 1];
+			}
+			return MxNumericView<NumericType>(m_data, newDims, newStrides);
+		}
+		/*
+		 * Match groups of old and new dimensions with equal products. Each
+		 * old group must be laid out as a single strided run.
+		 */
+		const mwSize numOldDims = m_dimensions.size();
+		const mwSize numNewDims = newDims.size();
+		mwSize oldBegin = 0;
+		mwSize newBegin = 0;
+		while ((oldBegin < numOldDims) && (newBegin < numNewDims)) {
+			mwSize oldEnd = oldBegin + 1;
+			mwSize newEnd = newBegin + 1;
+			mwSize oldProduct = m_dimensions[oldBegin];
+			mwSize newProduct = newDims[newBegin];
+			while (oldProduct != newProduct) {
+				if (newProduct < oldProduct) {
+					newProduct *= newDims[newEnd++];
+				} else {
+					oldProduct *= m_dimensions[oldEnd++];
+				}
+			}
+			mwSize baseStride = 0;
+			bool isBaseSet = false;
+			for (mwSize iter = oldBegin; iter < oldEnd; ++iter) {
+				if (m_dimensions[iter] == 1) {
+					continue;
+				}
+				if (!isBaseSet) {
+					baseStride = m_strides[iter];
+					isBaseSet = true;
+				}
+				for (mwSize next = iter + 1; next < oldEnd; ++next) {
+					if (m_dimensions[next] == 1) {
+						continue;
+					}
+					mexAssertEx(m_strides[next]
+								== m_strides[iter] * m_dimensions[iter],
+								"Reshape requires a copy");
+					break;
+				}
+			}
+			newStrides[newBegin] = baseStride;
+			for (mwSize iter = newBegin + 1; iter < newEnd; ++iter) {
+				newStrides[iter] = newStrides[iter - 1] * newDims[iter - 1];
+			}
+			oldBegin = oldEnd;
+			newBegin = newEnd;
+		}
+		return MxNumericView<NumericType>(m_data, newDims, newStrides);
+	}
+
+	/*
+	 * Copies the viewed elements into a new, contiguous array.
+	 */
+	inline MxNumeric<ValueType> materialize() const {
+		MxNumeric<ValueType> retArg(kUninitialized, m_dimensions.size(),
+									m_dimensions.data());
+		detail::PermutePlan(m_dimensions, m_strides).execute(
+											static_cast<const NumericType*>(
+																	m_data),
+											retArg.getData());
+		return retArg;
+	}
+
+private:
+	NumericType* m_data;
+	std::vector<mwSize> m_dimensions;
+	std::vector<mwSize> m_strides;
+};
+
+namespace detail {
+
+inline mwSize getMaxThreads() {
+#ifdef _OPENMP
+	return static_cast<mwSize>(omp_get_max_threads());
+#else
+	return 1;
+#endif
+}
+
+template <typename NumericType>
+inline PMxArrayNative createSparseArray(const mwSize numRows,
+										const mwSize numColumns,
+										const mwSize capacity) {
+	return mxCreateSparse(numRows, numColumns, capacity,
+						MxNumericClass<NumericType>::m_complexity);
+}
+
+template <>
+inline PMxArrayNative createSparseArray<mxLogical>(const mwSize numRows,
+												const mwSize numColumns,
+												const mwSize capacity) {
+	return mxCreateSparseLogicalMatrix(numRows, numColumns, capacity);
+}
+
+/*
+ * How duplicate triplets are combined: summed, or or-ed for logical values,
+ * as MATLAB's sparse does.
+ */
+template <typename NumericType>
+inline void accumulateDuplicate(NumericType& sum, const NumericType& value) {
+	sum += value;
+}
+
+inline void accumulateDuplicate(mxLogical& sum, const mxLogical& value) {
+	sum = sum || value;
+}
+
+template <typename NumericType>
+inline bool isNonzero(const NumericType& value) {
+	return std::not_equal_to<NumericType>()(value, NumericType());
+}
+
+}  // namespace detail
+
+/*
+ * Nonzeros of one column of an MxSparse, in increasing row order. Iterators
+ * dereference to the value, and get_row() gives its row.
+ */
+template <typename NumericType>
+class MxSparseColumn {
+public:
+	class iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef NumericType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef NumericType* pointer;
+		typedef NumericType& reference;
+
+		iterator(const mwIndex* rowIndices, NumericType* data) :
+				m_rowIndices(rowIndices),
+				m_data(data) {}
+
+		inline NumericType& operator*() const {
+			return *m_data;
+		}
+
+		inline mwIndex get_row() const {
+			return *m_rowIndices;
+		}
+
+		inline iterator& operator++() {
+			++m_rowIndices;
+			++m_data;
+			return *this;
+		}
+
+		inline iterator operator++(int) {
+			iterator retArg(*this);
+			++(*this);
+			return retArg;
+		}
+
+		inline bool operator==(const iterator& other) const {
+			return m_data == other.m_data;
+		}
+
+		inline bool operator!=(const iterator& other) const {
+			return m_data != other.m_data;
+		}
+
+	private:
+		const mwIndex* m_rowIndices;
+		NumericType* m_data;
+	};
+
+	MxSparseColumn(const mwIndex* rowIndices, NumericType* data,
+				const mwSize numberOfNonzeros) :
+			m_rowIndices(rowIndices),
+			m_data(data),
+			m_numberOfNonzeros(numberOfNonzeros) {}
+
+	inline iterator begin() const {
+		return iterator(m_rowIndices, m_data);
+	}
+
+	inline iterator end() const {
+		return iterator(m_rowIndices + m_numberOfNonzeros,
+						m_data + m_numberOfNonzeros);
+	}
+
+	inline const mwIndex* getRowIndices() const {
+		return m_rowIndices;
+	}
+
+	inline NumericType* getData() const {
+		return m_data;
+	}
+
+	template <typename IndexType>
+	inline IndexType size() const {
+		return static_cast<IndexType>(m_numberOfNonzeros);
+	}
+
+	inline int size() const {
+		return size<int>();
+	}
+
+private:
+	const mwIndex* m_rowIndices;
+	NumericType* m_data;
+	mwSize m_numberOfNonzeros;
+};
+
+/*
+ * Sparse matrix, in MATLAB's compressed sparse column (CSC) layout: the
+ * nonzeros of column j are at positions getColumnStarts()[j] to
+ * getColumnStarts()[j + 1] of getRowIndices() and getData(), which point
+ * directly into the MATLAB array. NumericType is double or mxLogical, or
+ * std::complex<double> with the interleaved complex API. Indices are
+ * zero-based.
+ */
+template <typename NumericType>
+class MxSparse : public MxArray {
+public:
+	MxSparse() = default;
+	MxSparse(const MxSparse<NumericType>& other) = default;
+	MxSparse<NumericType>& operator=(const MxSparse<NumericType>& other)
+																	= default;
+	MxSparse(MxSparse<NumericType>&& other) = default;
+	MxSparse<NumericType>& operator=(MxSparse<NumericType>&& other) = default;
+
+	explicit MxSparse(const detail::PMxArrayNative array) :
+			MxArray(array) {
+		mexAssert(mxIsSparse(array));
+		mexAssert(detail::isNumericClass<NumericType>(array));
+	}
+
+	/*
+	 * All-zero matrix with room for capacity nonzeros.
+	 */
+	template <typename IndexType>
+	MxSparse(const IndexType numRows, const IndexType numColumns,
+			const IndexType capacity) :
+			MxSparse(detail::createSparseArray<NumericType>(
+											static_cast<mwSize>(numRows),
+											static_cast<mwSize>(numColumns),
+											static_cast<mwSize>(capacity))) {}
+
+	/*
+	 * From (row, column, value) triplets, as MATLAB's sparse: duplicates are
+	 * summed (or-ed for logical), and zeros are dropped. Triplets are
+	 * bucketed by column with a counting sort, and each column is then sorted
+	 * and compressed independently, in parallel.
+	 */
+	template <typename IndexType>
+	MxSparse(const IndexType numRows, const IndexType numColumns,
+			const IndexType* rowIndices, const IndexType* columnIndices,
+			const NumericType* values, const size_t numTriplets) :
+			MxSparse(createFromTriplets(static_cast<mwSize>(numRows),
+										static_cast<mwSize>(numColumns),
+										rowIndices, columnIndices, values,
+										numTriplets)) {}
+
+	template <typename IndexType>
+	MxSparse(const IndexType numRows, const IndexType numColumns,
+			const std::vector<IndexType>& rowIndices,
+			const std::vector<IndexType>& columnIndices,
+			const std::vector<NumericType>& values) :
+			MxSparse(numRows, numColumns, rowIndices.data(),
+					columnIndices.data(), values.data(),
+					getNumTriplets(rowIndices, columnIndices, values)) {}
+
+	inline const mwIndex* getRowIndices() const {
+		return mxGetIr(get_array());
+	}
+
+	inline mwIndex* getRowIndices() {
+		return mxGetIr(get_array());
+	}
+
+	inline const mwIndex* getColumnStarts() const {
+		return mxGetJc(get_array());
+	}
+
+	inline mwIndex* getColumnStarts() {
+		return mxGetJc(get_array());
+	}
+
+	inline const NumericType* getData() const {
+		return static_cast<const NumericType*>(mxGetData(get_array()));
+	}
+
+	inline NumericType* getData() {
+		return static_cast<NumericType*>(mxGetData(get_array()));
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfNonzeros() const {
+		return static_cast<IndexType>(
+						getColumnStarts()[getNumberOfColumns<mwSize>()]);
+	}
+
+	inline int getNumberOfNonzeros() const {
+		return getNumberOfNonzeros<int>();
+	}
+
+	template <typename IndexType>
+	inline IndexType getCapacity() const {
+		return static_cast<IndexType>(mxGetNzmax(get_array()));
+	}
+
+	inline int getCapacity() const {
+		return getCapacity<int>();
+	}
+
+	template <typename IndexType>
+	inline MxSparseColumn<NumericType> column(const IndexType j) {
+		mexAssert(static_cast<mwSize>(j) < getNumberOfColumns<mwSize>());
+		const mwIndex* columnStarts = getColumnStarts();
+		return MxSparseColumn<NumericType>(getRowIndices() + columnStarts[j],
+										getData() + columnStarts[j],
+										columnStarts[j + 1] - columnStarts[j]);
+	}
+
+	template <typename IndexType>
+	inline MxSparseColumn<const NumericType> column(const IndexType j) const {
+		mexAssert(static_cast<mwSize>(j) < getNumberOfColumns<mwSize>());
+		const mwIndex* columnStarts = getColumnStarts();
+		return MxSparseColumn<const NumericType>(
+										getRowIndices() + columnStarts[j],
+										getData() + columnStarts[j],
+										columnStarts[j + 1] - columnStarts[j]);
+	}
+
+	/*
+	 * A * dense, for dense with as many rows as A has columns.
+	 */
+	inline MxNumeric<NumericType> multiply(
+								const MxNumeric<NumericType>& dense) const {
+		mexAssert(dense.template getNumberOfRows<mwSize>()
+				== getNumberOfColumns<mwSize>());
+		const mwSize numVectors = dense.template getNumberOfColumns<mwSize>();
+		MxNumeric<NumericType> retArg(kUninitialized,
+									getNumberOfRows<mwSize>(), numVectors);
+		multiply(dense.getData(), numVectors, retArg.getData());
+		return retArg;
+	}
+
+	/*
+	 * A.' * dense (not conjugated), for dense with as many rows as A.
+	 */
+	inline MxNumeric<NumericType> transposeMultiply(
+								const MxNumeric<NumericType>& dense) const {
+		mexAssert(dense.template getNumberOfRows<mwSize>()
+				== getNumberOfRows<mwSize>());
+		const mwSize numVectors = dense.template getNumberOfColumns<mwSize>();
+		MxNumeric<NumericType> retArg(kUninitialized,
+									getNumberOfColumns<mwSize>(), numVectors);
+		transposeMultiply(dense.getData(), numVectors, retArg.getData());
+		return retArg;
+	}
+
+	/*
+	 * y = A * x, for numVectors column-major vectors. With several vectors
+	 * per thread, threads take whole vectors. Otherwise the nonzeros of each
+	 * vector's product are split evenly between threads, which accumulate into
+	 * private copies of y that are then summed. To bound that memory, no more
+	 * threads are used than there are nonzeros per row.
+	 */
+	void multiply(const NumericType* x, const mwSize numVectors,
+				NumericType* y) const {
+		static_assert(!std::is_same<NumericType, mxLogical>::value,
+					"Logical sparse matrices have no arithmetic.");
+		const mwSize numRows = getNumberOfRows<mwSize>();
+		const mwSize numColumns = getNumberOfColumns<mwSize>();
+		const mwSize numNonzeros = getNumberOfNonzeros<mwSize>();
+		const mwSize maxThreads = detail::getMaxThreads();
+		if ((numVectors >= maxThreads) && (maxThreads > 1)
+			&& (numNonzeros * numVectors >= kParallelThreshold)) {
+#pragma omp parallel for schedule(dynamic, 1)
+			for (mwSize iter = 0; iter < numVectors; ++iter) {
+				multiplyRange(0, numNonzeros, 0, x + iter * numColumns,
+							y + iter * numRows, true);
+			}
+			return;
+		}
+		const mwSize numThreads = (numNonzeros < kParallelThreshold)
+								? 1
+								: std::max(std::min(maxThreads,
+										numNonzeros / std::max(numRows,
+															mwSize(1))),
+										mwSize(1));
+		for (mwSize iter = 0; iter < numVectors; ++iter) {
+			const NumericType* xVector = x + iter * numColumns;
+			NumericType* yVector = y + iter * numRows;
+			if (numThreads == 1) {
+				multiplyRange(0, numNonzeros, 0, xVector, yVector, true);
+				continue;
+			}
+			std::vector<NumericType> partial((numThreads - 1) * numRows);
+#pragma omp parallel num_threads(numThreads)
+			{
+				mwSize thread = 0;
+				mwSize threadCount = 1;
+#ifdef _OPENMP
+				thread = static_cast<mwSize>(omp_get_thread_num());
+				threadCount = static_cast<mwSize>(omp_get_num_threads());
+#endif
+				NumericType* buffer = (thread == 0)
+									? yVector
+									: &partial[(thread - 1) * numRows];
+				std::fill_n(buffer, numRows, NumericType());
+				mwSize begin;
+				mwSize end;
+				detail::getThreadRange(numNonzeros, begin, end);
+				multiplyRange(begin, end, findColumn(begin), xVector, buffer,
+							false);
+#pragma omp barrier
+				detail::getThreadRange(numRows, begin, end);
+				for (mwSize iterThread = 1; iterThread < threadCount;
+					++iterThread) {
+					const NumericType* other = &partial[(iterThread - 1)
+														* numRows];
+					for (mwSize iterRow = begin; iterRow < end; ++iterRow) {
+						yVector[iterRow] += other[iterRow];
+					}
+				}
+			}
+		}
+	}
+
+	/*
+	 * y = A.' * x, for numVectors column-major vectors. Each element of y is
+	 * the dot product of a column of A with x, so columns are split between
+	 * threads with no shared writes.
+	 */
+	void transposeMultiply(const NumericType* x, const mwSize numVectors,
+						NumericType* y) const {
+		static_assert(!std::is_same<NumericType, mxLogical>::value,
+					"Logical sparse matrices have no arithmetic.");
+		const mwSize numRows = getNumberOfRows<mwSize>();
+		const mwSize numColumns = getNumberOfColumns<mwSize>();
+		const mwIndex* columnStarts = getColumnStarts();
+		const mwIndex* rowIndices = getRowIndices();
+		const NumericType* data = getData();
+#pragma omp parallel for schedule(dynamic, kColumnChunk) \
+		if (getNumberOfNonzeros<mwSize>() * numVectors >= kParallelThreshold)
+		for (mwSize iterColumn = 0; iterColumn < numColumns; ++iterColumn) {
+			for (mwSize iter = 0; iter < numVectors; ++iter) {
+				const NumericType* xVector = x + iter * numRows;
+				NumericType sum = NumericType();
+				for (mwIndex iterNonzero = columnStarts[iterColumn],
+					end = columnStarts[iterColumn + 1]; iterNonzero < end;
+					++iterNonzero) {
+					sum += data[iterNonzero] * xVector[rowIndices[iterNonzero]];
+				}
+				y[iter * numColumns + iterColumn] = sum;
+			}
+		}
+	}
+
+	virtual ~MxSparse() = default;
+
+private:
+	static const mwSize kParallelThreshold = 1 << 16;
+	static const mwSize kColumnChunk = 256;
+
+	/*
+	 * Checked before the delegated constructor reads the triplets.
+	 */
+	template <typename IndexType>
+	static size_t getNumTriplets(const std::vector<IndexType>& rowIndices,
+								const std::vector<IndexType>& columnIndices,
+								const std::vector<NumericType>& values) {
+		if ((rowIndices.size() != values.size())
+			|| (columnIndices.size() != values.size())) {
+			mexErrMsgIdAndTxt("MATLAB:mex",
+					"Triplet vectors have different sizes (%zu, %zu, %zu).\n",
+					rowIndices.size(), columnIndices.size(), values.size());
+		}
+		return values.size();
+	}
+
+	template <typename IndexType>
+	static detail::PMxArrayNative createFromTriplets(
+										const mwSize numRows,
+										const mwSize numColumns,
+										const IndexType* rowIndices,
+										const IndexType* columnIndices,
+										const NumericType* values,
+										const size_t numTriplets) {
+		typedef std::pair<mwIndex, NumericType> Entry;
+		std::vector<mwIndex> bucketStarts(numColumns + 1, 0);
+		for (size_t iter = 0; iter < numTriplets; ++iter) {
+			mexAssert(static_cast<mwSize>(rowIndices[iter]) < numRows);
+			mexAssert(static_cast<mwSize>(columnIndices[iter]) < numColumns);
+			++bucketStarts[static_cast<mwSize>(columnIndices[iter]) + 1];
+		}
+		std::partial_sum(bucketStarts.begin(), bucketStarts.end(),
+						bucketStarts.begin());
+		std::vector<Entry> entries(numTriplets);
+		std::vector<mwIndex> positions(bucketStarts.begin(),
+									bucketStarts.end() - 1);
+		for (size_t iter = 0; iter < numTriplets; ++iter) {
+			entries[positions[static_cast<mwSize>(columnIndices[iter])]++] =
+						Entry(static_cast<mwIndex>(rowIndices[iter]),
+							values[iter]);
+		}
+		std::vector<mwIndex> columnStarts(numColumns + 1, 0);
+#pragma omp parallel for schedule(dynamic, kColumnChunk) \
+		if (numTriplets >= kParallelThreshold)
+		for (mwSize iterColumn = 0; iterColumn < numColumns; ++iterColumn) {
+			const typename std::vector<Entry>::iterator begin =
+									entries.begin() + bucketStarts[iterColumn];
+			const typename std::vector<Entry>::iterator end =
+								entries.begin() + bucketStarts[iterColumn + 1];
+			std::sort(begin, end, [](const Entry& a, const Entry& b) {
+				return a.first < b.first;
+			});
+			typename std::vector<Entry>::iterator last = begin;
+			for (typename std::vector<Entry>::iterator iter = begin;
+				iter != end; ++iter) {
+				if ((last != begin) && ((last - 1)->first == iter->first)) {
+					detail::accumulateDuplicate((last - 1)->second,
+												iter->second);
+				} else {
+					*last++ = *iter;
+				}
+			}
+			last = std::remove_if(begin, last, [](const Entry& entry) {
+				return !detail::isNonzero(entry.second);
+			});
+			columnStarts[iterColumn + 1] = static_cast<mwIndex>(last - begin);
+		}
+		std::partial_sum(columnStarts.begin(), columnStarts.end(),
+						columnStarts.begin());
+		const detail::PMxArrayNative array =
+					detail::createSparseArray<NumericType>(numRows, numColumns,
+												columnStarts[numColumns]);
+		mwIndex* arrayRowIndices = mxGetIr(array);
+		mwIndex* arrayColumnStarts = mxGetJc(array);
+		NumericType* arrayData = static_cast<NumericType*>(mxGetData(array));
+		std::copy(columnStarts.begin(), columnStarts.end(), arrayColumnStarts);
+#pragma omp parallel for schedule(dynamic, kColumnChunk) \
+		if (numTriplets >= kParallelThreshold)
+		for (mwSize iterColumn = 0; iterColumn < numColumns; ++iterColumn) {
+			const mwIndex source = bucketStarts[iterColumn];
+			for (mwIndex iter = columnStarts[iterColumn],
+				end = columnStarts[iterColumn + 1]; iter < end; ++iter) {
+				const Entry& entry = entries[source + iter
+											- columnStarts[iterColumn]];
+				arrayRowIndices[iter] = entry.first;
+				arrayData[iter] = entry.second;
+			}
+		}
+		return array;
+	}
+
+	/*
+	 * Column of the nonzero at position, i.e. the last column starting at or
+	 * before it.
+	 */
+	inline mwSize findColumn(const mwIndex position) const {
+		const mwIndex* columnStarts = getColumnStarts();
+		return static_cast<mwSize>(std::upper_bound(columnStarts,
+								columnStarts + getNumberOfColumns<mwSize>() + 1,
+								position) - columnStarts) - 1;
+	}
+
+	/*
+	 * y += (or =, if isOverwrite) the product of the nonzeros at positions
+	 * [begin, end), the first of which is in column firstColumn, with x.
+	 */
+	inline void multiplyRange(const mwIndex begin, const mwIndex end,
+							const mwSize firstColumn, const NumericType* x,
+							NumericType* y, const bool isOverwrite) const {
+		const mwIndex* columnStarts = getColumnStarts();
+		const mwIndex* rowIndices = getRowIndices();
+		const NumericType* data = getData();
+		if (isOverwrite) {
+			std::fill_n(y, getNumberOfRows<mwSize>(), NumericType());
+		}
+		mwSize iterColumn = firstColumn;
+		mwIndex iterNonzero = begin;
+		while (iterNonzero < end) {
+			const mwIndex columnEnd = std::min(columnStarts[iterColumn + 1],
+												end);
+			const NumericType xValue = x[iterColumn];
+			for (; iterNonzero < columnEnd; ++iterNonzero) {
+				y[rowIndices[iterNonzero]] += data[iterNonzero] * xValue;
+			}
+			++iterColumn;
+		}
+	}
+};
+
+/*
+ * Lists of numeric types, to restrict visitNumeric to the types a kernel
+ * supports.
+ */
+template <typename... NumericTypes>
+struct MxTypeList {};
+
+typedef MxTypeList<double, float> MxFloatingPointTypes;
+typedef MxTypeList<INT8_T, UINT8_T, INT16_T, UINT16_T, INT32_T, UINT32_T,
+				INT64_T, UINT64_T> MxIntegerTypes;
+typedef MxTypeList<double, float, INT8_T, UINT8_T, INT16_T, UINT16_T, INT32_T,
+				UINT32_T, INT64_T, UINT64_T, mxLogical> MxNumericTypes;
+#if defined(MX_HAS_INTERLEAVED_COMPLEX) && MX_HAS_INTERLEAVED_COMPLEX
+typedef MxTypeList<std::complex<double>, std::complex<float> > MxComplexTypes;
+#endif
+
+namespace detail {
+
+template <size_t... Indices>
+struct IndexSequence {};
+
+template <size_t N, size_t... Indices>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Indices...> {};
+
+template <size_t... Indices>
+struct MakeIndexSequence<0, Indices...> {
+	typedef IndexSequence<Indices...> type;
+};
+
+/*
+ * All numeric and logical class IDs are below this. With the interleaved
+ * complex API, complex arrays are dispatched kNumVisitClasses entries after
+ * real ones. With the separate API, they are dispatched as real ones, whose
+ * data are their real part, as isNumericClass matches them.
+ */
+const size_t kNumVisitClasses = static_cast<size_t>(mxUINT64_CLASS) + 1;
+
+template <typename NumericType>
+constexpr size_t getVisitIndex() {
+	return static_cast<size_t>(MxNumericClass<NumericType>::m_classId)
+		+ ((MxNumericClass<NumericType>::m_complexity == mxCOMPLEX)
+			? kNumVisitClasses
+			: 0);
+}
+
+template <typename T>
+struct TypeIdentity {
+	typedef T type;
+};
+
+/*
+ * Type of List whose getVisitIndex is Index, or void if there is none.
+ */
+template <size_t Index, typename List>
+struct FindClassType;
+
+template <size_t Index>
+struct FindClassType<Index, MxTypeList<> > : TypeIdentity<void> {};
+
+template <size_t Index, typename Head, typename... Tail>
+struct FindClassType<Index, MxTypeList<Head, Tail...> > :
+		std::conditional<getVisitIndex<Head>() == Index,
+						TypeIdentity<Head>,
+						FindClassType<Index, MxTypeList<Tail...> > >::type {};
+
+template <typename List, typename Function>
+struct VisitResult;
+
+template <typename Head, typename... Tail, typename Function>
+struct VisitResult<MxTypeList<Head, Tail...>, Function> {
+	typedef decltype(std::declval<Function&>()(
+									std::declval<MxNumeric<Head>&>())) type;
+};
+
+template <typename Result, typename Function, typename NumericType>
+struct VisitThunk {
+	static Result call(const PMxArrayNative array, Function& function) {
+		MxNumeric<NumericType> numeric(array);
+		return function(numeric);
+	}
+};
+
+template <typename Result, typename Function>
+struct VisitThunk<Result, Function, void> {
+	static Result call(const PMxArrayNative array, Function& /* function */) {
+		mexErrMsgIdAndTxt("MATLAB:mex", "Unsupported class %s.\n",
+						mxGetClassName(array));
+		return Result();
+	}
+};
+
+/*
+ * Table of one call per class ID and complexity, built at compile time. Only
+ * the types of List are instantiated; other classes share the error entry.
+ */
+template <typename Result, typename Function, typename List,
+		size_t... Indices>
+inline Result visitNumeric(const PMxArrayNative array, Function& function,
+						IndexSequence<Indices...>) {
+	typedef Result (*Thunk)(const PMxArrayNative, Function&);
+	static constexpr Thunk kThunks[] = {
+		&VisitThunk<Result, Function,
+				typename FindClassType<Indices, List>::type>::call...
+	};
+	const size_t classId = static_cast<size_t>(mxGetClassID(array));
+#if defined(MX_HAS_INTERLEAVED_COMPLEX) && MX_HAS_INTERLEAVED_COMPLEX
+	const size_t index = (classId < kNumVisitClasses)
+						? classId
+						  + (mxIsComplex(array) ? kNumVisitClasses : 0)
+						: 0;
+#else
+	const size_t index = (classId < kNumVisitClasses) ? classId : 0;
+#endif
+	return kThunks[index](array, function);
+}
+
+}  // namespace detail
+
+/*
+ * Calls function with array as MxNumeric<T>, where T is the type of the
+ * class of array (see detail::isNumericClass for complex arrays), through a
+ * single table lookup. function must accept
+ * MxNumeric<T>& for all T in List (e.g. a struct with a template operator()),
+ * and return the same type for all of them. Classes not in List are errors.
+ */
+template <typename List = MxNumericTypes, typename Function>
+inline typename detail::VisitResult<List,
+						typename std::remove_reference<Function>::type>::type
+visitNumeric(const detail::PMxArrayNative array, Function&& function) {
+	typedef typename std::remove_reference<Function>::type FunctionType;
+	typedef typename detail::VisitResult<List, FunctionType>::type Result;
+	return detail::visitNumeric<Result, FunctionType, List>(array, function,
+				typename detail::MakeIndexSequence<
+										2 * detail::kNumVisitClasses>::type());
+}
+
+template <typename List = MxNumericTypes, typename Function>
+inline typename detail::VisitResult<List,
+						typename std::remove_reference<Function>::type>::type
+visitNumeric(const MxArray& array, Function&& function) {
+	return visitNumeric<List>(array.get_array(),
+							std::forward<Function>(function));
+}
+
+/*
+ * Non-owning reference to a sequence of chars, along the lines of C++17's
+ * std::string_view.
+ */
+class StringView {
+public:
+	StringView() :
+			m_data(nullptr),
+			m_size(0) {}
+
+	StringView(const char* data, const size_t size) :
+			m_data(data),
+			m_size(size) {}
+
+	StringView(const char* cString) :
+			m_data(cString),
+			m_size(std::strlen(cString)) {}
+
+	StringView(const std::string& string) :
+			m_data(string.data()),
+			m_size(string.size()) {}
+
+	inline const char* data() const {
+		return m_data;
+	}
+
+	inline size_t size() const {
+		return m_size;
+	}
+
+	inline size_t length() const {
+		return m_size;
+	}
+
+	inline bool empty() const {
+		return (m_size == 0);
+	}
+
+	inline const char* begin() const {
+		return m_data;
+	}
+
+	inline const char* end() const {
+		return m_data + m_size;
+	}
+
+	template <typename IndexType>
+	inline char operator[](IndexType i) const {
+		mexAssert(static_cast<size_t>(i) < m_size);
+		return m_data[i];
+	}
+
+	inline std::string str() const {
+		return std::string(m_data, m_size);
+	}
+
+	inline bool operator==(const StringView& other) const {
+		return ((m_size == other.m_size)
+				&& ((m_size == 0)
+					|| (std::memcmp(m_data, other.m_data, m_size) == 0)));
+	}
+
+	inline bool operator!=(const StringView& other) const {
+		return !(*this == other);
+	}
+
+private:
+	const char* m_data;
+	size_t m_size;
+};
+
+namespace detail {
+
+/*
+ * Reads the code point starting at source[i] of a UTF-16 sequence, and
+ * advances i. Unpaired surrogates become U+FFFD.
+ */
+inline unsigned int decodeUtf16(const mxChar* source, const size_t size,
+								size_t& i) {
+	const unsigned int unit = static_cast<unsigned int>(source[i++]);
+	if ((unit < 0xD800) || (unit > 0xDFFF)) {
+		return unit;
+	}
+	if ((unit < 0xDC00) && (i < size)) {
+		const unsigned int next = static_cast<unsigned int>(source[i]);
+		if ((next >= 0xDC00) && (next <= 0xDFFF)) {
+			++i;
+			return 0x10000 + ((unit - 0xD800) << 10) + (next - 0xDC00);
+		}
+	}
+	return 0xFFFD;
+}
+
+/*
+ * Writes the UTF-8 encoding of codePoint to destination, and returns its
+ * length in bytes.
+ */
+inline size_t encodeUtf8(const unsigned int codePoint, char* destination) {
+	if (codePoint < 0x80) {
+		destination[0] = static_cast<char>(codePoint);
+		return 1;
+	} else if (codePoint < 0x800) {
+		destination[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+		destination[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+		return 2;
+	} else if (codePoint < 0x10000) {
+		destination[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+		destination[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+		destination[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+		return 3;
+	}
+	destination[0] = static_cast<char>(0xF0 | (codePoint >> 18));
+	destination[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+	destination[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+	destination[3] = static_cast<char>(0x80 | (codePoint & 0x3F));
+	return 4;
+}
+
+/*
+ * Narrows an ASCII prefix of source into destination, a block at a time with
+ * a loop the compiler vectorizes, and returns the length of the prefix.
+ */
+inline size_t narrowAscii(const mxChar* source, const size_t size,
+						char* destination) {
+	const size_t kBlockSize = 64;
+	size_t i = 0;
+	for (; i + kBlockSize <= size; i += kBlockSize) {
+		unsigned int mask = 0;
+#pragma omp simd reduction(|:mask)
+		for (size_t iter = 0; iter < kBlockSize; ++iter) {
+			mask |= static_cast<unsigned int>(source[i + iter]);
+			destination[i + iter] = static_cast<char>(source[i + iter]);
+		}
+		if (mask >= 0x80) {
+			break;
+		}
+	}
+	while ((i < size) && (static_cast<unsigned int>(source[i]) < 0x80)) {
+		destination[i] = static_cast<char>(source[i]);
+		++i;
+	}
+	return i;
+}
+
+/*
+ * Appends the UTF-8 conversion of UTF-16 source to destination.
+ */
+inline void appendUtf16AsUtf8(const mxChar* source, const size_t size,
+							std::string& destination) {
+	if (size == 0) {
+		return;
+	}
+	const size_t start = destination.size();
+	destination.resize(start + size);
+	const size_t asciiSize = narrowAscii(source, size, &destination[start]);
+	if (asciiSize == size) {
+		return;
+	}
+	size_t utf8Size = asciiSize;
+	char buffer[4];
+	for (size_t i = asciiSize; i < size; ) {
+		utf8Size += encodeUtf8(decodeUtf16(source, size, i), buffer);
+	}
+	destination.resize(start + utf8Size);
+	size_t position = start + asciiSize;
+	for (size_t i = asciiSize; i < size; ) {
+		position += encodeUtf8(decodeUtf16(source, size, i),
+								&destination[position]);
+	}
+}
+
+/*
+ * Converts UTF-16 source to UTF-8, replacing the contents of destination.
+ */
+inline void convertUtf16ToUtf8(const mxChar* source, const size_t size,
+							std::string& destination) {
+	destination.clear();
+	appendUtf16AsUtf8(source, size, destination);
+}
+
+/*
+ * Reads the code point starting at source[i] of a UTF-8 sequence, and
+ * advances i. Malformed sequences become U+FFFD.
+ */
+inline unsigned int decodeUtf8(const char* source, const size_t size,
+							size_t& i) {
+	const unsigned int lead = static_cast<unsigned char>(source[i++]);
+	if (lead < 0x80) {
+		return lead;
+	}
+	size_t length;
+	unsigned int codePoint;
+	if ((lead & 0xE0) == 0xC0) {
+		length = 1;
+		codePoint = lead & 0x1F;
+	} else if ((lead & 0xF0) == 0xE0) {
+		length = 2;
+		codePoint = lead & 0x0F;
+	} else if ((lead & 0xF8) == 0xF0) {
+		length = 3;
+		codePoint = lead & 0x07;
+	} else {
+		return 0xFFFD;
+	}
+	for (size_t iter = 0; iter < length; ++iter) {
+		if ((i == size)
+			|| ((static_cast<unsigned char>(source[i]) & 0xC0) != 0x80)) {
+			return 0xFFFD;
+		}
+		codePoint = (codePoint << 6)
+					| (static_cast<unsigned char>(source[i++]) & 0x3F);
+	}
+	return codePoint;
+}
+
+/*
+ * Number of UTF-16 code units needed for UTF-8 source.
+ */
+inline size_t getUtf16Length(const char* source, const size_t size) {
+	size_t length = 0;
+	for (size_t i = 0; i < size; ) {
+		if (static_cast<unsigned char>(source[i]) < 0x80) {
+			++length;
+			++i;
+		} else {
+			length += (decodeUtf8(source, size, i) >= 0x10000) ? 2 : 1;
+		}
+	}
+	return length;
+}
+
+/*
+ * Converts UTF-8 source to UTF-16 destination, which must have room for
+ * getUtf16Length(source, size) code units.
+ */
+inline void convertUtf8ToUtf16(const char* source, const size_t size,
+							mxChar* destination) {
+	size_t position = 0;
+	for (size_t i = 0; i < size; ) {
+		if (static_cast<unsigned char>(source[i]) < 0x80) {
+			destination[position++] = static_cast<mxChar>(source[i++]);
+			continue;
+		}
+		const unsigned int codePoint = decodeUtf8(source, size, i);
+		if (codePoint >= 0x10000) {
+			destination[position++] = static_cast<mxChar>(
+										0xD800 + ((codePoint - 0x10000) >> 10));
+			destination[position++] = static_cast<mxChar>(
+										0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+		} else {
+			destination[position++] = static_cast<mxChar>(codePoint);
+		}
+	}
+}
+
+/*
+ * Compares UTF-16 source with UTF-8 target without converting either.
+ */
+inline bool equalsUtf8(const mxChar* source, const size_t size,
+					const char* target, const size_t targetSize) {
+	size_t position = 0;
+	char buffer[4];
+	for (size_t i = 0; i < size; ) {
+		const unsigned int unit = static_cast<unsigned int>(source[i]);
+		if (unit < 0x80) {
+			if ((position == targetSize)
+				|| (target[position] != static_cast<char>(unit))) {
+				return false;
+			}
+			++position;
+			++i;
+			continue;
+		}
+		const size_t length = encodeUtf8(decodeUtf16(source, size, i), buffer);
+		if ((position + length > targetSize)
+			|| (std::memcmp(buffer, target + position, length) != 0)) {
+			return false;
+		}
+		position += length;
+	}
+	return (position == targetSize);
+}
+
+}  // namespace detail
+
+/*
+ * The characters are converted to a UTF-8 std::string only when first asked
+ * for (get_string, c_str, get_view, operator[]), with a single allocation.
+ * Comparisons with equals and == work directly on the mxChar data.
+ *
+ * The first conversion writes the cached string even through const members,
+ * so an MxString is not thread-safe, even when const: convert it, for example
+ * with get_string(), before sharing it between threads. Later conversions
+ * only read the cache.
+ */
+class MxString: public MxArray {
+public:
+
+	MxString() :
+			MxArray(),
+			m_string(),
+			m_isConverted(false) {}
+	MxString(const MxString& other) = default;
+	MxString& operator=(const MxString& other) = default;
+	MxString(MxString&& other) = default;
+	MxString& operator=(MxString&& other) = default;
+
+	friend void swap(MxString& first, MxString& second) {
+		using std::swap;
+		swap(static_cast<MxArray&>(first), static_cast<MxArray&>(second));
+		swap(first.m_string, second.m_string);
+		swap(first.m_isConverted, second.m_isConverted);
+	}
+
+	explicit MxString(const detail::PMxArrayNative array) :
+			MxArray(array), m_string(), m_isConverted(false) {
+		mexAssert(MxStringClass::m_classId == mxGetClassID(array));
+	}
+
+	explicit MxString(const char* cString) :
+			MxArray(mxCreateString(cString)), m_string(), m_isConverted(false) {}
+
+	explicit MxString(const std::string& string) :
+			MxString(string.c_str()) {}
+
+	inline void clone(const MxString& other) {
+		mexAssert(getDimensions() == other.getDimensions());
+		mxChar *destination = static_cast<mxChar*>(mxGetData(get_array()));
+		const mxChar *origin = static_cast<const mxChar*>(
+											mxGetData(other.get_array()));
+		std::memcpy(static_cast<void*>(destination),
+			static_cast<const void*>(origin),
+			getNumberOfElements<size_t>() * sizeof(mxChar));
+		m_string = other.m_string;
+		m_isConverted = other.m_isConverted;
+	}
+
+	inline const mxChar* getData() const {
+		return static_cast<const mxChar*>(mxGetData(get_array()));
+	}
+
+	inline const std::string& get_string() const {
+		if (!m_isConverted) {
+			detail::convertUtf16ToUtf8(getData(), getNumberOfElements<size_t>(),
+									m_string);
+			m_isConverted = true;
+		}
+		return m_string;
+	}
+
+	inline const char* c_str() const {
+		return get_string().c_str();
+	}
+
+	inline StringView get_view() const {
+		return StringView(get_string());
+	}
+
+	inline bool equals(const StringView& other) const {
+		return detail::equalsUtf8(getData(), getNumberOfElements<size_t>(),
+								other.data(), other.size());
+	}
+
+	inline bool operator==(const StringView& other) const {
+		return equals(other);
+	}
+
+	inline bool operator!=(const StringView& other) const {
+		return !equals(other);
+	}
+
+	/*
+	 * Access to the converted characters. Writes do not change the array.
+	 */
+	template <typename IndexType>
+	inline char& operator[](IndexType i) {
+		get_string();
+		mexAssert(static_cast<size_t>(i) < m_string.size());
+		return m_string[i];
+	}
+
+	template <typename IndexType>
+	inline const char& operator[](IndexType i) const {
+		mexAssert(static_cast<size_t>(i) < get_string().size());
+		return get_string()[i];
+	}
+
+	template <typename IndexType>
+	inline IndexType length() const {
+		return getNumberOfElements<IndexType>();
+	}
+
+	inline int length() const {
+		return getNumberOfElements<int>();
+	}
+
+	virtual ~MxString() = default;
+
+private:
+	mutable std::string m_string;
+	mutable bool m_isConverted;
+};
+
+namespace detail {
+
+struct CellElementGetter {
+	static inline PMxArrayNative get(const PMxArrayNative array,
+									const mwIndex index) {
+		return mxGetCell(array, index);
+	}
+};
+
+struct StructFieldGetter {
+	static inline PMxArrayNative get(const PMxArrayNative array,
+									const mwIndex index) {
+		return mxGetFieldByNumber(array, 0, static_cast<int>(index));
+	}
+};
+
+/*
+ * Iterator over the elements of a cell or the fields of a struct. It only
+ * holds the parent array and an index, and dereferences to a new wrapper of
+ * type MxArrayType (which checks the class of the element on construction).
+ */
+template <typename MxArrayType, typename ElementGetter>
+class MxArrayElementIterator {
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = MxArrayType;
+	using difference_type = std::ptrdiff_t;
+	using pointer = void;
+	using reference = MxArrayType;
+
+	MxArrayElementIterator() = default;
+
+	MxArrayElementIterator(const PMxArrayNative array, const mwIndex index) :
+			m_array(array),
+			m_index(index) {}
+
+	inline MxArrayType operator*() const {
+		return MxArrayType(ElementGetter::get(m_array, m_index));
+	}
+
+	inline MxArrayElementIterator& operator++() {
+		++m_index;
+		return *this;
+	}
+
+	inline MxArrayElementIterator operator++(int) {
+		MxArrayElementIterator retArg(*this);
+		++m_index;
+		return retArg;
+	}
+
+	inline bool operator==(const MxArrayElementIterator& other) const {
+		return (m_index == other.m_index);
+	}
+
+	inline bool operator!=(const MxArrayElementIterator& other) const {
+		return (m_index != other.m_index);
+	}
+
+	inline mwIndex get_index() const {
+		return m_index;
+	}
+
+private:
+	PMxArrayNative m_array;
+	mwIndex m_index;
+};
+
+template <typename Iterator>
+class IteratorRange {
+public:
+	IteratorRange(const Iterator& begin, const Iterator& end) :
+			m_begin(begin),
+			m_end(end) {}
+
+	inline Iterator begin() const {
+		return m_begin;
+	}
+
+	inline Iterator end() const {
+		return m_end;
+	}
+
+private:
+	Iterator m_begin;
+	Iterator m_end;
+};
+
+}  // namespace detail
+
+class MxCell : public MxArray {
+public:
+
+	MxCell() = default;
+	MxCell(const MxCell& other) = default;
+	MxCell& operator=(const MxCell& other) = default;
+	MxCell(MxCell&& other) = default;
+	MxCell& operator=(MxCell&& other) = default;
+
+	/*
+	 * TODO: Because of this, initialization from scalar PMxArrayNative is
+	 * disabled.
+	 */
+	explicit MxCell(const detail::PMxArrayNative array) :
+			MxArray(array) {
+		mexAssert(MxCellClass::m_classId == mxGetClassID(array));
+	}
+
+	template <typename IndexType>
+	MxCell(const detail::PMxArrayNative* arrVar, const IndexType numDims,
+			const IndexType *dims) :
+			MxCell(mxCreateCellArray(static_cast<mwSize>(numDims),
+									std::vector<mwSize>(dims, dims + numDims)
+														.data())) {
+		if (arrVar != nullptr) {
+			for (int iter = 0; iter < getNumberOfElements(); ++iter) {
+				mxSetCell(get_array(), iter, arrVar[iter]);
+			}
+		}
+	}
+
+	template <typename IndexType>
+	MxCell(const detail::PMxArray* arrVar, const IndexType numDims,
+			const IndexType *dims) :
+			MxCell(mxCreateCellArray(static_cast<mwSize>(numDims),
+									std::vector<mwSize>(dims, dims + numDims)
+														.data())) {
+		if (arrVar != nullptr) {
+			for (int iter = 0; iter < getNumberOfElements(); ++iter) {
+				mxSetCell(get_array(), iter, arrVar[iter]->get_array());
+			}
+		}
+	}
+
+	template <typename IndexType>
+	MxCell(const IndexType numDims, const IndexType *dims) :
+			MxCell(static_cast<const detail::PMxArrayNative*>(nullptr), numDims,
+				dims) {}
+
+	template <typename IndexType>
+	MxCell(const IndexType numRows, const IndexType numColumns) :
+			MxCell(static_cast<const detail::PMxArrayNative*>(nullptr),
+				static_cast<mwSize>(2),
+				detail::array2D{numRows, numColumns}.data()) {}
+
+	template <typename IndexType>
+	MxCell(const detail::PMxArrayNative* arrVar, const IndexType numRows,
+			const IndexType numColumns) :
+			MxCell(arrVar, static_cast<mwSize>(2),
+				detail::array2D{numRows, numColumns}.data()) {}
+
+	template <typename IndexType>
+	MxCell(const detail::PMxArray* arrVar, const IndexType numRows,
+			const IndexType numColumns) :
+			MxCell(arrVar, static_cast<mwSize>(2),
+				detail::array2D{numRows, numColumns}.data()) {}
+
+	explicit MxCell(const std::vector<detail::PMxArray>& vecVar) :
+			MxCell(vecVar.data(), static_cast<mwSize>(2),
+				detail::array2D{vecVar.size(), 1}.data()) {}
+
+	template <std::size_t ArraySize>
+	explicit MxCell(const std::array<detail::PMxArray, ArraySize>& arrVar) :
+			MxCell(arrVar.data(), static_cast<mwSize>(2),
+				detail::array2D{ArraySize, 1}.data()) {}
+
+	/*
+	 * TODO: Remember to change this if I add constructor from MxArray to all
+	 * derived classes of MxArray.
+	 */
+	explicit MxCell(const detail::PMxArray scalarVar) :
+			MxCell(&scalarVar, static_cast<mwSize>(2),
+				detail::array2D{1, 1}.data()) {}
+
+	template <typename IndexType>
+	MxCell(const detail::PMxArrayNative* arrVar,
+			const std::vector<IndexType>& dims) :
+			MxCell(arrVar, dims.size(), dims.data()) {}
+
+	template <typename IndexType>
+	MxCell(const detail::PMxArray* arrVar, const std::vector<IndexType>& dims) :
+			MxCell(arrVar, dims.size(), dims.data()) {}
+
+	/*
+	 * TODO: The following field access operators (getData, [], and vectorize)
+	 * require some thought for the const case. Should I make the pointers const
+	 * too?
+	 */
+	template <typename IndexType>
+	inline detail::PMxArrayNative operator[](IndexType i) {
+		mexAssert(i < getNumberOfElements<IndexType>());
+		return mxGetCell(get_array(), i);
+	}
+
+	template <typename IndexType>
+	inline detail::PMxArrayNative operator[](IndexType i) const {
+		mexAssert(i < getNumberOfElements<IndexType>());
+		return mxGetCell(get_array(), i);
+	}
+
+	inline const detail::PMxArrayNative* getData() const {
+		return static_cast<const detail::PMxArrayNative*>(mxGetData(
+																get_array()));
+	}
+
+	inline detail::PMxArrayNative* getData() {
+		return static_cast<detail::PMxArrayNative*>(mxGetData(get_array()));
+	}
+
+	inline const std::vector<detail::PMxArrayNative> vectorize() const {
+		std::vector<detail::PMxArrayNative> retArg;
+		retArg.reserve(getNumberOfElements<size_t>());
+		for (int iter = 0, end = getNumberOfElements(); iter < end; ++iter) {
+			retArg.push_back((mxGetCell(get_array(), iter)));
+		}
+		return retArg;
+	}
+
+	inline std::vector<detail::PMxArrayNative> vectorize() {
+		std::vector<detail::PMxArrayNative> retArg;
+		retArg.reserve(getNumberOfElements<size_t>());
+		for (int iter = 0, end = getNumberOfElements(); iter < end; ++iter) {
+			retArg.push_back((mxGetCell(get_array(), iter)));
+		}
+		return retArg;
+	}
+
+	/*
+	 * Iteration over the cell elements, as MxArray, or as MxArrayType with
+	 * elements<MxArrayType>(), e.g.
+	 * 	for (const MxString& name : cell.elements<MxString>()) { ... }
+	 */
+	template <typename MxArrayType>
+	using element_iterator = detail::MxArrayElementIterator<MxArrayType,
+												detail::CellElementGetter>;
+	using iterator = element_iterator<MxArray>;
+
+	inline iterator begin() const {
+		return iterator(get_array(), 0);
+	}
+
+	inline iterator end() const {
+		return iterator(get_array(), getNumberOfElements<mwIndex>());
+	}
+
+	template <typename MxArrayType>
+	inline detail::IteratorRange<element_iterator<MxArrayType> > elements()
+																	const {
+		return detail::IteratorRange<element_iterator<MxArrayType> >(
+					element_iterator<MxArrayType>(get_array(), 0),
+					element_iterator<MxArrayType>(get_array(),
+											getNumberOfElements<mwIndex>()));
+	}
+
+	virtual ~MxCell() = default;
+};
+
+/*
+ * Strings stored back to back, each followed by a '\0', in a single buffer,
+ * with the offset of each string. Filled by MxCellString::extract.
+ */
+class StringTable {
+public:
+	StringTable() :
+			m_data(),
+			m_offsets(1, 0) {}
+
+	inline void clear() {
+		m_data.clear();
+		m_offsets.assign(1, 0);
+	}
+
+	inline void reserve(const size_t numStrings, const size_t numChars) {
+		m_offsets.reserve(numStrings + 1);
+		m_data.reserve(numChars + numStrings);
+	}
+
+	inline void append(const mxChar* source, const size_t size) {
+		detail::appendUtf16AsUtf8(source, size, m_data);
+		m_data.push_back('\0');
+		m_offsets.push_back(m_data.size());
+	}
+
+	inline size_t size() const {
+		return m_offsets.size() - 1;
+	}
+
+	template <typename IndexType>
+	inline StringView operator[](IndexType i) const {
+		mexAssert(static_cast<size_t>(i) < size());
+		return StringView(m_data.data() + m_offsets[i],
+						m_offsets[i + 1] - m_offsets[i] - 1);
+	}
+
+	template <typename IndexType>
+	inline const char* c_str(IndexType i) const {
+		mexAssert(static_cast<size_t>(i) < size());
+		return m_data.data() + m_offsets[i];
+	}
+
+	inline const std::string& get_data() const {
+		return m_data;
+	}
+
+	inline const std::vector<size_t>& get_offsets() const {
+		return m_offsets;
+	}
+
+private:
+	std::string m_data;
+	std::vector<size_t> m_offsets;
+};
+
+/*
+ * Cell array of char arrays (cellstr). Empty cells are read as empty strings.
+ */
+class MxCellString : public MxCell {
+public:
+	MxCellString() = default;
+	MxCellString(const MxCellString& other) = default;
+	MxCellString& operator=(const MxCellString& other) = default;
+	MxCellString(MxCellString&& other) = default;
+	MxCellString& operator=(MxCellString&& other) = default;
+
+	explicit MxCellString(const detail::PMxArrayNative array) :
+			MxCell(array) {}
+
+	/*
+	 * Creates a cell of the given dimensions (by default a column), with one
+	 * char row per string, converting directly from UTF-8 to mxChar.
+	 */
+	template <typename IndexType>
+	MxCellString(const std::vector<std::string>& vecVar,
+				const std::vector<IndexType>& dims) :
+			MxCell(dims.size(), dims.data()) {
+		mexAssert(getNumberOfElements<size_t>() == vecVar.size());
+		for (size_t iter = 0, end = vecVar.size(); iter < end; ++iter) {
+			const std::string& string = vecVar[iter];
+			const size_t length = detail::getUtf16Length(string.data(),
+														string.size());
+			const detail::array2D charDims{static_cast<mwSize>(
+															length > 0 ? 1 : 0),
+										length};
+			detail::PMxArrayNative element = mxCreateCharArray(2,
+															charDims.data());
+			detail::convertUtf8ToUtf16(string.data(), string.size(),
+									static_cast<mxChar*>(mxGetData(element)));
+			mxSetCell(get_array(), iter, element);
+		}
+	}
+
+	explicit MxCellString(const std::vector<std::string>& vecVar) :
+			MxCellString(vecVar, std::vector<mwSize>{vecVar.size(), 1}) {}
+
+	template <typename IndexType>
+	inline MxString getString(IndexType i) const {
+		return MxString((*this)[i]);
+	}
+
+	/*
+	 * Converts all strings into table, with one buffer for all characters:
+	 * a first pass over the cell sizes the buffer, and a second one fills it.
+	 */
+	inline void extract(StringTable& table) const {
+		const size_t numel = getNumberOfElements<size_t>();
+		size_t numChars = 0;
+		for (size_t iter = 0; iter < numel; ++iter) {
+			const detail::PMxArrayNative element = mxGetCell(get_array(), iter);
+			if (element != nullptr) {
+				numChars += mxGetNumberOfElements(element);
+			}
+		}
+		table.clear();
+		table.reserve(numel, numChars);
+		for (size_t iter = 0; iter < numel; ++iter) {
+			const detail::PMxArrayNative element = mxGetCell(get_array(), iter);
+			if ((element == nullptr) || mxIsEmpty(element)) {
+				table.append(nullptr, 0);
+				continue;
+			}
+			mexAssertEx(mxGetClassID(element) == MxStringClass::m_classId,
+						"Cell element is not a char array");
+			table.append(static_cast<const mxChar*>(mxGetData(element)),
+						mxGetNumberOfElements(element));
+		}
+	}
+
+	inline StringTable extract() const {
+		StringTable table;
+		extract(table);
+		return table;
+	}
+
+	inline std::vector<std::string> vectorizeStrings() const {
+		const StringTable table = extract();
+		std::vector<std::string> retArg;
+		retArg.reserve(table.size());
+		for (size_t iter = 0, end = table.size(); iter < end; ++iter) {
+			retArg.push_back(table[iter].str());
+		}
+		return retArg;
+	}
+
+	virtual ~MxCellString() = default;
+};
+
+namespace detail {
+
+/*
+ * mxMAXNAM includes the terminating null character.
+ */
+inline bool isValidFieldName(const std::string& name) {
+	return (name.size() < static_cast<size_t>(mxMAXNAM));
+}
+
+/*
+ * c_str() of each name, as mxCreateStructMatrix expects them.
+ */
+inline std::vector<const char*> getFieldNamePointers(
+										const std::vector<std::string>& vecName) {
+	std::vector<const char*> retArg;
+	retArg.reserve(vecName.size());
+	for (size_t iter = 0, end = vecName.size(); iter < end; ++iter) {
+		mexAssert(isValidFieldName(vecName[iter]));
+		retArg.push_back(vecName[iter].c_str());
+	}
+	return retArg;
+}
+
+inline std::vector<std::string> getFieldNames(const PMxArrayNative array) {
+	const int numFields = mxGetNumberOfFields(array);
+	std::vector<std::string> retArg;
+	retArg.reserve(static_cast<size_t>(numFields));
+	for (int iter = 0; iter < numFields; ++iter) {
+		retArg.push_back(std::string(mxGetFieldNameByNumber(array, iter)));
+	}
+	return retArg;
+}
+
+}  // namespace detail
+
+/*
+ * Field number of a struct, resolved once by name with getFieldHandle, so
+ * that repeated field accesses skip the search by name.
+ */
+class MxFieldHandle {
+public:
+	constexpr MxFieldHandle() :
+			m_number(-1) {}
+
+	constexpr explicit MxFieldHandle(const int number) :
+			m_number(number) {}
+
+	constexpr int get_number() const {
+		return m_number;
+	}
+
+	constexpr bool isValid() const {
+		return m_number != -1;
+	}
+
+private:
+	int m_number;
+};
+
+class MxStruct : public MxArray {
+public:
+	MxStruct() = default;
+	MxStruct(const MxStruct& other) = default;
+	MxStruct& operator=(const MxStruct& other) = default;
+	MxStruct(MxStruct&& other) = default;
+	MxStruct& operator=(MxStruct&& other) = default;
+
+	explicit MxStruct(const detail::PMxArrayNative array) :
+			MxArray(array) {
+		mexAssert(MxStructClass::m_classId == mxGetClassID(array));
+	}
+
+	MxStruct(const std::vector<std::string>& vecName,
+			const std::vector<detail::PMxArray>& vecVar) :
+			MxStruct((vecName.size() == vecVar.size())
+					?(mxCreateStructMatrix(static_cast<mwSize>(1),
+										static_cast<mwSize>(1),
+										static_cast<int>(vecName.size()),
+										detail::getFieldNamePointers(vecName)
+															.data()))
+					:(nullptr)) {
+		mexAssert(get_array() != nullptr);
+		for (int iter = 0, end = getNumberOfFields(); iter < end; ++iter) {
+			mxSetFieldByNumber(get_array(), 0, iter, vecVar[iter]->get_array());
+		}
+	}
+
+//	MxStruct(const std::string& scalarName,
+//			const detail::PMxArrayNative scalarVar) :
+//			MxStruct(std::vector<std::string>(1, scalarName),
+//					std::vector<detail::PMxArrayNative>(1, scalarVar)) {}
+
+	MxStruct(const std::string& scalarName, const detail::PMxArray scalarVar) :
+			MxStruct(std::vector<std::string>(1, scalarName),
+					std::vector<detail::PMxArray>(1, scalarVar)) {}
+
+	void addField(const std::string& scalarName,
+				const detail::PMxArrayNative scalarVar) {
+		addField_sub(&scalarName, &scalarVar, static_cast<mwSize>(1));
+	}
+
+	void addField(const std::string& scalarName,
+				const detail::PMxArray scalarVar) {
+		addField_sub(&scalarName, &scalarVar, static_cast<mwSize>(1));
+	}
+
+	void addField(const std::vector<std::string>& vecName,
+				const std::vector<detail::PMxArrayNative>& vecVar) {
+		mexAssert(vecVar.size() == vecName.size());
+		addField_sub(&vecName[0], &vecVar[0], vecVar.size());
+	}
+
+	void addField(const std::vector<std::string>& vecName,
+				const std::vector<detail::PMxArray>& vecVar) {
+		mexAssert(vecVar.size() == vecName.size());
+		addField_sub(&vecName[0], &vecVar[0], vecVar.size());
+	}
+
+	inline bool isField(const std::string& name) const {
+		return (mxGetFieldNumber(get_array(), name.c_str()) != -1);
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfFields() const {
+		return static_cast<IndexType>(mxGetNumberOfFields(get_array()));
+	}
+
+	inline int getNumberOfFields() const {
+		return getNumberOfFields<int>();
+	}
+
+	template <typename IndexType>
+	inline IndexType getFieldNumber(const std::string& name) const {
+		return static_cast<IndexType>(mxGetFieldNumber(get_array(),
+													name.c_str()));
+	}
+
+	inline int getFieldNumber(const std::string& name) const {
+		return getFieldNumber<int>(name);
+	}
+
+	template <typename IndexType>
+	inline std::string getFieldName(const IndexType i) const {
+		return std::string(mxGetFieldNameByNumber(get_array(),
+												static_cast<int>(i)));
+	}
+
+	inline std::vector<std::string> getFieldNames() const {
+		return detail::getFieldNames(get_array());
+	}
+
+	inline MxFieldHandle getFieldHandle(const std::string& name) const {
+		return MxFieldHandle(mxGetFieldNumber(get_array(), name.c_str()));
+	}
+
+	inline std::vector<MxFieldHandle> getFieldHandles(
+									const std::vector<std::string>& vecName) const {
+		std::vector<MxFieldHandle> retArg;
+		retArg.reserve(vecName.size());
+		for (size_t iter = 0, end = vecName.size(); iter < end; ++iter) {
+			retArg.push_back(getFieldHandle(vecName[iter]));
+		}
+		return retArg;
+	}
+
+	/*
+	 * TODO: The following field access operators (getData, [], and vectorize)
+	 * require some thought for the const case. Should I make the pointers const
+	 * too?
+	 */
+	template <typename IndexType>
+	inline detail::PMxArrayNative operator[](IndexType i) {
+		mexAssert(i < getNumberOfFields());
+		return mxGetFieldByNumber(get_array(), 0, static_cast<int>(i));
+	}
+
+	template <typename IndexType>
+	inline detail::PMxArrayNative operator[](IndexType i) const {
+		return mxGetFieldByNumber(get_array(), 0, static_cast<int>(i));
+	}
+
+	inline detail::PMxArrayNative operator[](const std::string& name) {
+		return mxGetField(get_array(), 0, name.c_str());
+	}
+
+	inline detail::PMxArrayNative operator[](const std::string& name) const {
+		return mxGetField(get_array(), 0, name.c_str());
+	}
+
+	inline detail::PMxArrayNative operator[](const MxFieldHandle field) {
+		mexAssert(field.isValid());
+		return mxGetFieldByNumber(get_array(), 0, field.get_number());
+	}
+
+	inline detail::PMxArrayNative operator[](const MxFieldHandle field) const {
+		mexAssert(field.isValid());
+		return mxGetFieldByNumber(get_array(), 0, field.get_number());
+	}
+
+	/*
+	 * Sets the field to value, which the struct then owns. The previous
+	 * value, if any, is destroyed.
+	 */
+	inline void set(const MxFieldHandle field,
+					const detail::PMxArrayNative value) {
+		const detail::PMxArrayNative previous = (*this)[field];
+		if (previous != nullptr) {
+			mxDestroyArray(previous);
+		}
+		mxSetFieldByNumber(get_array(), 0, field.get_number(), value);
+	}
+
+	inline void set(const MxFieldHandle field, const detail::PMxArray value) {
+		set(field, value->get_array());
+	}
+
+	inline const detail::PMxArrayNative* getData() const {
+		return static_cast<detail::PMxArrayNative*>(mxGetData(get_array()));
+	}
+
+	inline detail::PMxArrayNative* getData() {
+		return static_cast<detail::PMxArrayNative*>(mxGetData(get_array()));
+	}
+
+	inline void vectorize(std::vector<std::string>& vecName,
+						std::vector<detail::PMxArrayNative>& vecVar) const {
+		vecName.resize(0);
+		vecVar.resize(0);
+		for (int iter = 0, end = getNumberOfFields(); iter < end; ++iter) {
+			const char* tempName = mxGetFieldNameByNumber(get_array(), iter);
+			vecName.push_back(std::string(tempName));
+			detail::PMxArrayNative tempVar = mxGetFieldByNumber(get_array(), 0,
+																iter);
+			vecVar.push_back(tempVar);
+		}
+	}
+
+	/*
+	 * Iteration over the field values, as MxArray, or as MxArrayType with
+	 * fields<MxArrayType>(). The iterator's get_index() is the field number.
+	 */
+	template <typename MxArrayType>
+	using field_iterator = detail::MxArrayElementIterator<MxArrayType,
+												detail::StructFieldGetter>;
+	using iterator = field_iterator<MxArray>;
+
+	inline iterator begin() const {
+		return iterator(get_array(), 0);
+	}
+
+	inline iterator end() const {
+		return iterator(get_array(), getNumberOfFields<mwIndex>());
+	}
+
+	template <typename MxArrayType>
+	inline detail::IteratorRange<field_iterator<MxArrayType> > fields() const {
+		return detail::IteratorRange<field_iterator<MxArrayType> >(
+					field_iterator<MxArrayType>(get_array(), 0),
+					field_iterator<MxArrayType>(get_array(),
+											getNumberOfFields<mwIndex>()));
+	}
+
+	virtual ~MxStruct() = default;
+private:
+	template <typename IndexType>
+	void addField_sub(const std::string* arrName,
+					const detail::PMxArrayNative* arrVar,
+					IndexType numFields) {
+		for (IndexType iter = 0; iter < numFields; ++iter) {
+			mexAssert(detail::isValidFieldName(arrName[iter]));
+			const int fieldNumber = mxAddField(get_array(),
+											arrName[iter].c_str());
+			mxSetFieldByNumber(get_array(), 0, fieldNumber, arrVar[iter]);
+		}
+	}
+
+	template <typename IndexType>
+	void addField_sub(const std::string* arrName,
+					const detail::PMxArray* arrVar,
+					IndexType numFields) {
+		for (IndexType iter = 0; iter < numFields; ++iter) {
+			mexAssert(detail::isValidFieldName(arrName[iter]));
+			const int fieldNumber = mxAddField(get_array(),
+											arrName[iter].c_str());
+			mxSetFieldByNumber(get_array(), 0, fieldNumber,
+							arrVar[iter]->get_array());
+		}
+	}
+};
+
+namespace detail {
+
+/*
+ * visitNumeric function for MxStructArray::gatherField, called with the field
+ * of the first record. Returns false at the first record whose field is not a
+ * real scalar of the same class, without reading it.
+ */
+template <typename NumericType>
+class StructScalarGatherer {
+public:
+	StructScalarGatherer(const PMxArrayNative array, const int fieldNumber,
+						NumericType* values) :
+			m_array(array),
+			m_fieldNumber(fieldNumber),
+			m_values(values) {}
+
+	template <typename SourceType>
+	bool operator()(const MxNumeric<SourceType>& /* first */) const {
+		const mxClassID classId = MxNumericClass<SourceType>::m_classId;
+		for (mwIndex iter = 0, end = mxGetNumberOfElements(m_array);
+			iter < end; ++iter) {
+			const PMxArrayNative element = mxGetFieldByNumber(m_array, iter,
+															m_fieldNumber);
+			if ((element == nullptr) || (mxGetClassID(element) != classId)
+				|| (mxGetNumberOfElements(element) != 1)
+				|| mxIsComplex(element)) {
+				return false;
+			}
+			m_values[iter] = static_cast<NumericType>(
+								*static_cast<const SourceType*>(mxGetData(element)));
+		}
+		return true;
+	}
+
+private:
+	PMxArrayNative m_array;
+	int m_fieldNumber;
+	NumericType* m_values;
+};
+
+}  // namespace detail
+
+/*
+ * Struct array, with fields accessed per record, and whole fields of scalar
+ * records gathered into, or scattered from, contiguous vectors.
+ */
+class MxStructArray : public MxArray {
+public:
+	MxStructArray() = default;
+	MxStructArray(const MxStructArray& other) = default;
+	MxStructArray& operator=(const MxStructArray& other) = default;
+	MxStructArray(MxStructArray&& other) = default;
+	MxStructArray& operator=(MxStructArray&& other) = default;
+
+	explicit MxStructArray(const detail::PMxArrayNative array) :
+			MxArray(array) {
+		mexAssert(MxStructClass::m_classId == mxGetClassID(array));
+	}
+
+	/*
+	 * Creates a numRows x numColumns struct array with the given fields, all
+	 * empty.
+	 */
+	template <typename IndexType>
+	MxStructArray(const IndexType numRows, const IndexType numColumns,
+				const std::vector<std::string>& vecName) :
+			MxStructArray(mxCreateStructMatrix(static_cast<mwSize>(numRows),
+											static_cast<mwSize>(numColumns),
+											static_cast<int>(vecName.size()),
+											detail::getFieldNamePointers(vecName).data())) {}
+
+	template <typename IndexType>
+	MxStructArray(const IndexType numRecords,
+				const std::vector<std::string>& vecName) :
+			MxStructArray(numRecords, static_cast<IndexType>(1), vecName) {}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfRecords() const {
+		return getNumberOfElements<IndexType>();
+	}
+
+	inline int getNumberOfRecords() const {
+		return getNumberOfRecords<int>();
+	}
+
+	inline int addField(const std::string& name) {
+		mexAssert(detail::isValidFieldName(name));
+		return mxAddField(get_array(), name.c_str());
+	}
+
+	inline bool isField(const std::string& name) const {
+		return (mxGetFieldNumber(get_array(), name.c_str()) != -1);
 	}
 
 	template <typename IndexType>
-	inline IndexType length() const {
-		return getNumberOfElements<IndexType>();
+	inline IndexType getNumberOfFields() const {
+		return static_cast<IndexType>(mxGetNumberOfFields(get_array()));
 	}
 
-	inline int length() const {
-		return getNumberOfElements<int>();
+	inline int getNumberOfFields() const {
+		return getNumberOfFields<int>();
 	}
 
-	virtual ~MxString() = default;
+	inline int getFieldNumber(const std::string& name) const {
+		return mxGetFieldNumber(get_array(), name.c_str());
+	}
 
-private:
-	std::string m_string;
-};
+	inline MxFieldHandle getFieldHandle(const std::string& name) const {
+		return MxFieldHandle(getFieldNumber(name));
+	}
 
-class MxCell : public MxArray {
-public:
+	template <typename IndexType>
+	inline std::string getFieldName(const IndexType i) const {
+		return std::string(mxGetFieldNameByNumber(get_array(),
+												static_cast<int>(i)));
+	}
 
-	MxCell() = default;
-	MxCell(const MxCell& other) = default;
-	MxCell& operator=(const MxCell& other) = default;
-	MxCell(MxCell&& other) = default;
-	MxCell& operator=(MxCell&& other) = default;
+	inline std::vector<std::string> getFieldNames() const {
+		return detail::getFieldNames(get_array());
+	}
 
 	/*
-	 * TODO: Because of this, initialization from scalar PMxArrayNative is
-	 * disabled.
+	 * Field fieldNumber of record i. May be nullptr for unset fields.
 	 */
-	explicit MxCell(const detail::PMxArrayNative array) :
-			MxArray(array) {
-		mexAssert(MxCellClass::m_classId == mxGetClassID(array));
+	template <typename IndexType>
+	inline detail::PMxArrayNative operator()(const IndexType i,
+											const int fieldNumber) const {
+		mexAssert(static_cast<size_t>(i) < getNumberOfRecords<size_t>());
+		return mxGetFieldByNumber(get_array(), static_cast<mwIndex>(i),
+								fieldNumber);
 	}
 
 	template <typename IndexType>
-	MxCell(const detail::PMxArrayNative* arrVar, const IndexType numDims,
-			const IndexType *dims) :
-			MxCell(mxCreateCellArray(static_cast<mwSize>(numDims),
-									std::vector<mwSize>(dims, dims + numDims)
-														.data())) {
-		if (arrVar != nullptr) {
-			for (int iter = 0; iter < getNumberOfElements(); ++iter) {
-				mxSetCell(get_array(), iter, arrVar[iter]);
-			}
-		}
+	inline detail::PMxArrayNative operator()(const IndexType i,
+											const MxFieldHandle field) const {
+		return (*this)(i, field.get_number());
 	}
 
 	template <typename IndexType>
-	MxCell(const detail::PMxArray* arrVar, const IndexType numDims,
-			const IndexType *dims) :
-			MxCell(mxCreateCellArray(static_cast<mwSize>(numDims),
-									std::vector<mwSize>(dims, dims + numDims)
-														.data())) {
-		if (arrVar != nullptr) {
-			for (int iter = 0; iter < getNumberOfElements(); ++iter) {
-				mxSetCell(get_array(), iter, arrVar[iter]->get_array());
-			}
-		}
+	inline detail::PMxArrayNative operator()(const IndexType i,
+											const std::string& name) const {
+		const int fieldNumber = getFieldNumber(name);
+		mexAssert(fieldNumber != -1);
+		return (*this)(i, fieldNumber);
 	}
 
+	/*
+	 * Sets field fieldNumber of record i to value, which the struct then
+	 * owns. The previous value, if any, is destroyed.
+	 */
 	template <typename IndexType>
-	MxCell(const IndexType numDims, const IndexType *dims) :
-			MxCell(nullptr, numDims, dims) {}
+	inline void set(const IndexType i, const int fieldNumber,
+					const detail::PMxArrayNative value) {
+		const detail::PMxArrayNative previous = (*this)(i, fieldNumber);
+		if (previous != nullptr) {
+			mxDestroyArray(previous);
+		}
+		mxSetFieldByNumber(get_array(), static_cast<mwIndex>(i), fieldNumber,
+						value);
+	}
 
 	template <typename IndexType>
-	MxCell(const IndexType numRows, const IndexType numColumns) :
-			MxCell(nullptr, static_cast<mwSize>(2),
-				detail::array2D{numRows, numColumns}.data()) {}
+	inline void set(const IndexType i, const int fieldNumber,
+					const detail::PMxArray value) {
+		set(i, fieldNumber, value->get_array());
+	}
 
-	template <typename IndexType>
-	MxCell(const detail::PMxArrayNative* arrVar, const IndexType numRows,
-			const IndexType numColumns) :
-			MxCell(arrVar, static_cast<mwSize>(2),
-				detail::array2D{numRows, numColumns}.data()) {}
+	template <typename IndexType, typename ValueType>
+	inline void set(const IndexType i, const MxFieldHandle field,
+					const ValueType value) {
+		set(i, field.get_number(), value);
+	}
 
-	template <typename IndexType>
-	MxCell(const detail::PMxArray* arrVar, const IndexType numRows,
-			const IndexType numColumns) :
-			MxCell(arrVar, static_cast<mwSize>(2),
-				detail::array2D{numRows, numColumns}.data()) {}
+	/*
+	 * Copies the scalar value of field fieldNumber of every record into
+	 * values, converting to NumericType. The class of the field is resolved
+	 * from the first record; all records must hold scalars of that class.
+	 */
+	template <typename NumericType>
+	void gatherField(const int fieldNumber,
+					std::vector<NumericType>& values) const {
+		mexAssert((fieldNumber >= 0) && (fieldNumber < getNumberOfFields()));
+		const size_t numRecords = getNumberOfRecords<size_t>();
+		values.resize(numRecords);
+		if (numRecords == 0) {
+			return;
+		}
+		const detail::PMxArrayNative first = mxGetFieldByNumber(get_array(), 0,
+																fieldNumber);
+		if ((first == nullptr)
+			|| !visitNumeric(first, detail::StructScalarGatherer<NumericType>(
+														get_array(), fieldNumber,
+														values.data()))) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Field %s is not a real numeric "
+							"scalar of the same class in all records.\n",
+							mxGetFieldNameByNumber(get_array(), fieldNumber));
+		}
+	}
 
-	explicit MxCell(const std::vector<detail::PMxArray>& vecVar) :
-			MxCell(vecVar.data(), static_cast<mwSize>(2),
-				detail::array2D{vecVar.size(), 1}.data()) {}
+	template <typename NumericType>
+	inline std::vector<NumericType> gatherField(const int fieldNumber) const {
+		std::vector<NumericType> retArg;
+		gatherField(fieldNumber, retArg);
+		return retArg;
+	}
 
-	template <std::size_t ArraySize>
-	explicit MxCell(const std::array<detail::PMxArray, ArraySize>& arrVar) :
-			MxCell(arrVar.data(), static_cast<mwSize>(2),
-				detail::array2D{ArraySize, 1}.data()) {}
+	template <typename NumericType>
+	inline std::vector<NumericType> gatherField(
+											const MxFieldHandle field) const {
+		return gatherField<NumericType>(field.get_number());
+	}
+
+	template <typename NumericType>
+	inline std::vector<NumericType> gatherField(const std::string& name) const {
+		const int fieldNumber = getFieldNumber(name);
+		if (fieldNumber == -1) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "No field %s.\n", name.c_str());
+		}
+		return gatherField<NumericType>(fieldNumber);
+	}
 
 	/*
-	 * TODO: Remember to change this if I add constructor from MxArray to all
-	 * derived classes of MxArray.
+	 * Sets field fieldNumber of every record to a scalar of class
+	 * MxNumericClass<NumericType> holding the corresponding element of values.
 	 */
-	explicit MxCell(const detail::PMxArray scalarVar) :
-			MxCell(&scalarVar, static_cast<mwSize>(2),
-				detail::array2D{1, 1}.data()) {}
+	template <typename NumericType>
+	void scatterField(const int fieldNumber, const NumericType* values) {
+		mexAssert((fieldNumber >= 0) && (fieldNumber < getNumberOfFields()));
+		const mwSize dims[2] = {1, 1};
+		for (mwIndex iter = 0, end = getNumberOfRecords<mwIndex>(); iter < end;
+			++iter) {
+			const detail::PMxArrayNative scalar = detail::createNumericArray(
+										static_cast<mwSize>(2), dims,
+										MxNumericClass<NumericType>::m_classId,
+										false,
+										MxNumericClass<NumericType>::m_complexity);
+			*static_cast<NumericType*>(mxGetData(scalar)) = values[iter];
+			set(iter, fieldNumber, scalar);
+		}
+	}
 
-	template <typename IndexType>
-	MxCell(const detail::PMxArrayNative* arrVar,
-			const std::vector<IndexType>& dims) :
-			MxCell(arrVar, dims.size(), dims.data()) {}
+	template <typename NumericType>
+	inline void scatterField(const int fieldNumber,
+							const std::vector<NumericType>& values) {
+		mexAssert(values.size() == getNumberOfRecords<size_t>());
+		scatterField(fieldNumber, values.data());
+	}
 
-	template <typename IndexType>
-	MxCell(const detail::PMxArray* arrVar, const std::vector<IndexType>& dims) :
-			MxCell(arrVar, dims.size(), dims.data()) {}
+	template <typename NumericType>
+	inline void scatterField(const MxFieldHandle field,
+							const std::vector<NumericType>& values) {
+		scatterField(field.get_number(), values);
+	}
+
+	template <typename NumericType>
+	inline void scatterField(const std::string& name,
+							const std::vector<NumericType>& values) {
+		int fieldNumber = getFieldNumber(name);
+		if (fieldNumber == -1) {
+			fieldNumber = addField(name);
+		}
+		scatterField(fieldNumber, values);
+	}
+
+	virtual ~MxStructArray() = default;
+};
+
+/*
+ * Field names fixed at compile time. Structs created from the schema hold
+ * field I at number I, so get<I>() needs no lookup at all; structs received
+ * as arguments are mapped once with resolve().
+ */
+template <size_t N>
+class MxStructSchema {
+public:
+	template <typename... NameTypes>
+	constexpr explicit MxStructSchema(const NameTypes... names) :
+			m_names{{names...}} {
+		static_assert(sizeof...(NameTypes) == N,
+					"Number of field names does not match schema size.");
+	}
+
+	template <size_t I>
+	static constexpr MxFieldHandle get() {
+		static_assert(I < N, "Field index out of schema bounds.");
+		return MxFieldHandle(static_cast<int>(I));
+	}
+
+	static constexpr size_t size() {
+		return N;
+	}
+
+	inline const char* getFieldName(const size_t i) const {
+		return m_names[i];
+	}
 
 	/*
-	 * TODO: The following field access operators (getData, [], and vectorize)
-	 * require some thought for the const case. Should I make the pointers const
-	 * too?
+	 * 1x1 struct with all fields empty, in a single mxCreateStructMatrix call.
 	 */
-	template <typename IndexType>
-	inline detail::PMxArrayNative operator[](IndexType i) {
-		mexAssert(i < getNumberOfElements<IndexType>());
-		return mxGetCell(get_array(), i);
+	inline MxStruct createStruct() const {
+		return MxStruct(mxCreateStructMatrix(static_cast<mwSize>(1),
+											static_cast<mwSize>(1),
+											static_cast<int>(N),
+											const_cast<const char**>(
+															m_names.data())));
 	}
 
 	template <typename IndexType>
-	inline detail::PMxArrayNative operator[](IndexType i) const {
-		mexAssert(i < getNumberOfElements<IndexType>());
-		return mxGetCell(get_array(), i);
+	inline MxStructArray createStructArray(const IndexType numRows,
+										const IndexType numColumns) const {
+		return MxStructArray(mxCreateStructMatrix(static_cast<mwSize>(numRows),
+											static_cast<mwSize>(numColumns),
+											static_cast<int>(N),
+											const_cast<const char**>(
+															m_names.data())));
 	}
 
-	inline const detail::PMxArrayNative* getData() const {
-		return static_cast<const detail::PMxArrayNative*>(mxGetData(
-																get_array()));
+	/*
+	 * Field handles of array, in schema order. Missing fields are invalid
+	 * handles.
+	 */
+	inline std::array<MxFieldHandle, N> resolve(const MxArray& array) const {
+		mexAssert(array.isStruct());
+		std::array<MxFieldHandle, N> retArg;
+		for (size_t iter = 0; iter < N; ++iter) {
+			retArg[iter] = MxFieldHandle(mxGetFieldNumber(array.get_array(),
+														m_names[iter]));
+		}
+		return retArg;
 	}
 
-	inline detail::PMxArrayNative* getData() {
-		return static_cast<detail::PMxArrayNative*>(mxGetData(get_array()));
+	/*
+	 * Whether array has exactly the schema fields in schema order, so that
+	 * get<I>() handles apply to it.
+	 */
+	inline bool matches(const MxArray& array) const {
+		if (!array.isStruct()
+			|| (mxGetNumberOfFields(array.get_array()) != static_cast<int>(N))) {
+			return false;
+		}
+		for (size_t iter = 0; iter < N; ++iter) {
+			if (std::strcmp(mxGetFieldNameByNumber(array.get_array(),
+												static_cast<int>(iter)),
+							m_names[iter]) != 0) {
+				return false;
+			}
+		}
+		return true;
 	}
 
-	inline const std::vector<detail::PMxArrayNative> vectorize() const {
-		std::vector<detail::PMxArrayNative> retArg;
-		for (int iter = 0, end = getNumberOfElements(); iter < end; ++iter) {
-			retArg.push_back((mxGetCell(get_array(), iter)));
+private:
+	std::array<const char*, N> m_names;
+};
+
+template <typename... NameTypes>
+constexpr MxStructSchema<sizeof...(NameTypes)> makeStructSchema(
+												const NameTypes... names) {
+	return MxStructSchema<sizeof...(NameTypes)>(names...);
+}
+
+/*
+ * Free list of numeric arrays, keyed by class and dimensions, that outlives
+ * mex calls so that temporaries of repeated calls can reuse each other's
+ * buffers. Typically a static object used through MxArrayScope. Pooled arrays
+ * are made persistent; call clear() (e.g. registered with mexAtExit) to free
+ * them before the mex file is cleared. maxBytes bounds the size of the pool.
+ */
+class MxArrayPool {
+public:
+	explicit MxArrayPool(const size_t maxBytes = static_cast<size_t>(-1)) :
+			m_maxBytes(maxBytes),
+			m_bytes(0),
+			m_arrays() {}
+
+	MxArrayPool(const MxArrayPool& other) = delete;
+	MxArrayPool& operator=(const MxArrayPool& other) = delete;
+
+	/*
+	 * Returns a pooled, persistent array of the given class and dimensions,
+	 * or nullptr if there is none. Contents are unspecified.
+	 */
+	inline detail::PMxArrayNative acquire(const mxClassID classId,
+										const mwSize numDims,
+										const mwSize* dims) {
+		ArrayMap::iterator iter = m_arrays.find(getKey(classId, numDims,
+																dims));
+		if ((iter == m_arrays.end()) || iter->second.empty()) {
+			return nullptr;
 		}
-		return retArg;
+		const detail::PMxArrayNative array = iter->second.back();
+		iter->second.pop_back();
+		m_bytes -= getBytes(array);
+		return array;
 	}
 
-	inline std::vector<detail::PMxArrayNative> vectorize() {
-		std::vector<detail::PMxArrayNative> retArg;
-		for (int iter = 0, end = getNumberOfElements(); iter < end; ++iter) {
-			retArg.push_back((mxGetCell(get_array(), iter)));
+	/*
+	 * Takes ownership of array, and keeps it for reuse if it fits.
+	 */
+	inline void recycle(const detail::PMxArrayNative array,
+						const bool isPersistent) {
+		const size_t bytes = getBytes(array);
+		if (!isRecyclable(array) || (m_bytes + bytes > m_maxBytes)) {
+			mxDestroyArray(array);
+			return;
 		}
-		return retArg;
+		if (!isPersistent) {
+			mexMakeArrayPersistent(array);
+		}
+		m_arrays[getKey(mxGetClassID(array),
+						mxGetNumberOfDimensions(array),
+						mxGetDimensions(array))].push_back(array);
+		m_bytes += bytes;
 	}
 
-	virtual ~MxCell() = default;
+	inline void clear() {
+		for (ArrayMap::iterator iter = m_arrays.begin(),
+			end = m_arrays.end(); iter != end; ++iter) {
+			for (size_t iterArray = 0, endArray = iter->second.size();
+				iterArray < endArray; ++iterArray) {
+				mxDestroyArray(iter->second[iterArray]);
+			}
+		}
+		m_arrays.clear();
+		m_bytes = 0;
+	}
+
+	inline size_t getNumberOfBytes() const {
+		return m_bytes;
+	}
+
+	~MxArrayPool() {
+		clear();
+	}
+
+private:
+	using ArrayKey = std::pair<mxClassID, std::vector<mwSize> >;
+	using ArrayMap = std::map<ArrayKey, std::vector<detail::PMxArrayNative> >;
+
+	static inline ArrayKey getKey(const mxClassID classId, mwSize numDims,
+								const mwSize* dims) {
+		while ((numDims > 2) && (dims[numDims - 1] == 1)) {
+			--numDims;
+		}
+		return ArrayKey(classId, std::vector<mwSize>(dims, dims + numDims));
+	}
+
+	static inline bool isRecyclable(const detail::PMxArrayNative array) {
+		return ((mxIsNumeric(array) || mxIsLogical(array))
+				&& !mxIsSparse(array) && !mxIsComplex(array));
+	}
+
+	static inline size_t getBytes(const detail::PMxArrayNative array) {
+		return mxGetNumberOfElements(array) * mxGetElementSize(array);
+	}
+
+	size_t m_maxBytes;
+	size_t m_bytes;
+	ArrayMap m_arrays;
 };
 
-class MxStruct : public MxArray {
+/*
+ * Owner of the temporary arrays created during one mex call. Arrays created or
+ * adopted through the scope are destroyed when it ends, or, if the scope was
+ * given a pool, returned to it for reuse. Arrays that leave the scope, as
+ * outputs or as elements of a cell or struct, must first be promoted.
+ */
+class MxArrayScope {
 public:
-	MxStruct() = default;
-	MxStruct(const MxStruct& other) = default;
-	MxStruct& operator=(const MxStruct& other) = default;
-	MxStruct(MxStruct&& other) = default;
-	MxStruct& operator=(MxStruct&& other) = default;
+	MxArrayScope() :
+			m_pool(nullptr),
+			m_arrays() {}
+
+	explicit MxArrayScope(MxArrayPool& pool) :
+			m_pool(&pool),
+			m_arrays() {}
+
+	MxArrayScope(const MxArrayScope& other) = delete;
+	MxArrayScope& operator=(const MxArrayScope& other) = delete;
+
+	/*
+	 * Creates an array with any of MxArrayType's constructors.
+	 */
+	template <typename MxArrayType, typename... Args>
+	inline MxArrayType create(Args&&... args) {
+		return adopt(MxArrayType(std::forward<Args>(args)...));
+	}
+
+	/*
+	 * Creates a numeric array, reusing a pooled one of the same class and
+	 * dimensions if possible. Reused arrays are not zeroed.
+	 */
+	template <typename NumericType, typename IndexType>
+	inline MxNumeric<NumericType> createNumeric(const IndexType numDims,
+												const IndexType* dims) {
+		const std::vector<mwSize> dimensions(dims, dims + numDims);
+		const detail::PMxArrayNative array = ((m_pool != nullptr)
+					&& (MxNumericClass<NumericType>::m_complexity == mxREAL))
+						? m_pool->acquire(MxNumericClass<NumericType>::m_classId,
+										dimensions.size(), dimensions.data())
+						: nullptr;
+		if (array == nullptr) {
+			return create<MxNumeric<NumericType> >(dimensions.size(),
+												dimensions.data());
+		}
+		m_arrays.push_back(Entry{array, true});
+		return MxNumeric<NumericType>(array);
+	}
+
+	template <typename NumericType, typename IndexType>
+	inline MxNumeric<NumericType> createNumeric(const IndexType numRows,
+												const IndexType numColumns) {
+		const detail::array2D dims{static_cast<mwSize>(numRows),
+								static_cast<mwSize>(numColumns)};
+		return createNumeric<NumericType>(static_cast<mwSize>(2), dims.data());
+	}
+
+	/*
+	 * Takes ownership of an array created elsewhere.
+	 */
+	template <typename MxArrayType>
+	inline MxArrayType adopt(const MxArrayType& array) {
+		m_arrays.push_back(Entry{array.get_array(), false});
+		return array;
+	}
+
+	/*
+	 * Releases an array from the scope, e.g. plhs[0] = scope.promote(array).
+	 * Pooled arrays are persistent, so for those a copy is returned instead,
+	 * and the original stays in the scope.
+	 */
+	inline detail::PMxArrayNative promote(const MxArray& array) {
+		for (size_t iter = m_arrays.size(); iter > 0; --iter) {
+			if (m_arrays[iter - 1].m_array != array.get_array()) {
+				continue;
+			}
+			if (m_arrays[iter - 1].m_isPersistent) {
+				return mxDuplicateArray(array.get_array());
+			}
+			m_arrays.erase(m_arrays.begin()
+						+ static_cast<std::ptrdiff_t>(iter - 1));
+			return array.get_array();
+		}
+		return array.get_array();
+	}
+
+	~MxArrayScope() {
+		for (size_t iter = 0, end = m_arrays.size(); iter < end; ++iter) {
+			if (m_pool != nullptr) {
+				m_pool->recycle(m_arrays[iter].m_array,
+								m_arrays[iter].m_isPersistent);
+			} else {
+				mxDestroyArray(m_arrays[iter].m_array);
+			}
+		}
+	}
+
+private:
+	struct Entry {
+		detail::PMxArrayNative m_array;
+		bool m_isPersistent;
+	};
+
+	MxArrayPool* m_pool;
+	std::vector<Entry> m_arrays;
+};
+
+/*
+ * Expected dimensions of an argument, -1 for any. Dimensions beyond those
+ * listed must be 1, and listed dimensions beyond those of the array are 1.
+ * Dims<> accepts any dimensions.
+ */
+template <long... Extents>
+struct Dims {
+	static inline bool isValid(const detail::PMxArrayNative array) {
+		const long extents[] = {Extents..., 0};
+		const mwSize numDims = mxGetNumberOfDimensions(array);
+		const mwSize* dims = mxGetDimensions(array);
+		const mwSize numExtents = sizeof...(Extents);
+		for (mwSize iter = 0; iter < std::max(numDims, numExtents); ++iter) {
+			const mwSize dim = (iter < numDims) ? dims[iter] : 1;
+			if ((iter < numExtents)
+				? ((extents[iter] >= 0)
+					&& (dim != static_cast<mwSize>(extents[iter])))
+				: (dim != 1)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static inline std::string describe() {
+		const long extents[] = {Extents..., 0};
+		std::string retArg;
+		for (size_t iter = 0; iter < sizeof...(Extents); ++iter) {
+			retArg += (iter == 0) ? "" : "x";
+			retArg += (extents[iter] < 0) ? std::string("N")
+										: std::to_string(extents[iter]);
+		}
+		return retArg;
+	}
+};
 
-	explicit MxStruct(const detail::PMxArrayNative array) :
-			MxArray(array) {
-		mexAssert(MxStructClass::m_classId == mxGetClassID(array));
+template <>
+struct Dims<> {
+	static inline bool isValid(const detail::PMxArrayNative /* array */) {
+		return true;
 	}
 
-	MxStruct(const std::vector<std::string>& vecName,
-			const std::vector<detail::PMxArray>& vecVar) :
-			MxStruct((vecName.size() == vecVar.size())
-					?(mxCreateStructMatrix(static_cast<mwSize>(1),
-										static_cast<mwSize>(1),
-										static_cast<mwSize>(0),
-										nullptr))
-					:(nullptr)) {
-		mexAssert(get_array() != nullptr);
-		addField_sub(vecName.data(), vecVar.data(),
-					static_cast<mwSize>(vecName.size()));
+	static inline std::string describe() {
+		return std::string();
 	}
+};
 
-//	MxStruct(const std::string& scalarName,
-//			const detail::PMxArrayNative scalarVar) :
-//			MxStruct(std::vector<std::string>(1, scalarName),
-//					std::vector<detail::PMxArrayNative>(1, scalarVar)) {}
+namespace detail {
 
-	MxStruct(const std::string& scalarName, const detail::PMxArray scalarVar) :
-			MxStruct(std::vector<std::string>(1, scalarName),
-					std::vector<detail::PMxArray>(1, scalarVar)) {}
+inline std::string getClassIdName(const mxClassID classId) {
+	switch (classId) {
+		case mxCELL_CLASS: return "cell";
+		case mxSTRUCT_CLASS: return "struct";
+		case mxLOGICAL_CLASS: return "logical";
+		case mxCHAR_CLASS: return "char";
+		case mxDOUBLE_CLASS: return "double";
+		case mxSINGLE_CLASS: return "single";
+		case mxINT8_CLASS: return "int8";
+		case mxUINT8_CLASS: return "uint8";
+		case mxINT16_CLASS: return "int16";
+		case mxUINT16_CLASS: return "uint16";
+		case mxINT32_CLASS: return "int32";
+		case mxUINT32_CLASS: return "uint32";
+		case mxINT64_CLASS: return "int64";
+		case mxUINT64_CLASS: return "uint64";
+		default: return "unknown";
+	}
+}
 
-	void addField(const std::string& scalarName,
-				const detail::PMxArrayNative scalarVar) {
-		addField_sub(&scalarName, &scalarVar, static_cast<mwSize>(1));
+/*
+ * Class check for each wrapper accepted by In, with the description used in
+ * error messages.
+ */
+template <typename MxArrayType>
+struct ArgumentTraits;
+
+template <>
+struct ArgumentTraits<MxArray> {
+	static inline bool isValid(const PMxArrayNative /* array */) {
+		return true;
 	}
 
-	void addField(const std::string& scalarName,
-				const detail::PMxArray scalarVar) {
-		addField_sub(&scalarName, &scalarVar, static_cast<mwSize>(1));
+	static inline std::string describe() {
+		return "any class";
 	}
+};
 
-	void addField(const std::vector<std::string>& vecName,
-				const std::vector<detail::PMxArrayNative>& vecVar) {
-		mexAssert(vecVar.size() == vecName.size());
-		addField_sub(&vecName[0], &vecVar[0], vecVar.size());
+template <typename NumericType>
+struct ArgumentTraits<MxNumeric<NumericType> > {
+	static inline bool isValid(const PMxArrayNative array) {
+		return isNumericClass<NumericType>(array) && !mxIsSparse(array);
 	}
 
-	void addField(const std::vector<std::string>& vecName,
-				const std::vector<detail::PMxArray>& vecVar) {
-		mexAssert(vecVar.size() == vecName.size());
-		addField_sub(&vecName[0], &vecVar[0], vecVar.size());
+	static inline std::string describe() {
+		return std::string((MxNumericClass<NumericType>::m_complexity
+							== mxCOMPLEX) ? "complex " : "")
+			+ getClassIdName(MxNumericClass<NumericType>::m_classId);
 	}
+};
 
-	inline bool isField(const std::string& name) const {
-		return (mxGetFieldNumber(get_array(), name.c_str()) != -1);
+template <typename NumericType>
+struct ArgumentTraits<MxSparse<NumericType> > {
+	static inline bool isValid(const PMxArrayNative array) {
+		return isNumericClass<NumericType>(array) && mxIsSparse(array);
 	}
 
-	template <typename IndexType>
-	inline IndexType getNumberOfFields() const {
-		return static_cast<IndexType>(mxGetNumberOfFields(get_array()));
+	static inline std::string describe() {
+		return "sparse " + ArgumentTraits<MxNumeric<NumericType> >::describe();
 	}
+};
 
-	inline int getNumberOfFields() const {
-		return getNumberOfFields<int>();
+template <>
+struct ArgumentTraits<MxString> {
+	static inline bool isValid(const PMxArrayNative array) {
+		return mxIsChar(array);
 	}
 
-	template <typename IndexType>
-	inline IndexType getFieldNumber(const std::string& name) const {
-		return static_cast<IndexType>(mxGetFieldNumber(get_array(),
-													name.c_str()));
+	static inline std::string describe() {
+		return "char";
 	}
+};
 
-	inline int getFieldNumber(const std::string& name) const {
-		return getFieldNumber<int>(name);
+template <>
+struct ArgumentTraits<MxCell> {
+	static inline bool isValid(const PMxArrayNative array) {
+		return mxIsCell(array);
 	}
 
-	template <typename IndexType>
-	inline std::string getFieldName(const IndexType i) const {
-		return std::string(mxGetFieldNameByNumber(get_array(),
-												static_cast<int>(i)));
+	static inline std::string describe() {
+		return "cell";
 	}
+};
 
-	inline std::vector<std::string> getFieldNames() const {
-		std::vector<std::string> retArg(0);
-		for (int iter = 0, end = getNumberOfFields(); iter < end; ++iter) {
-			retArg.push_back(std::string(mxGetFieldNameByNumber(get_array(),
-															iter)));
+template <>
+struct ArgumentTraits<MxCellString> {
+	static inline bool isValid(const PMxArrayNative array) {
+		if (!mxIsCell(array)) {
+			return false;
 		}
-		return retArg;
+		for (mwIndex iter = 0, end = mxGetNumberOfElements(array); iter < end;
+			++iter) {
+			const PMxArrayNative element = mxGetCell(array, iter);
+			if ((element != nullptr) && !mxIsChar(element)
+				&& !mxIsEmpty(element)) {
+				return false;
+			}
+		}
+		return true;
 	}
 
-	/*
-	 * TODO: The following field access operators (getData, [], and vectorize)
-	 * require some thought for the const case. Should I make the pointers const
-	 * too?
-	 */
-	template <typename IndexType>
-	inline detail::PMxArrayNative operator[](IndexType i) {
-		mexAssert(i < getNumberOfElements());
-		return mxGetFieldByNumber(get_array(), 0, static_cast<int>(i));
+	static inline std::string describe() {
+		return "cell array of char";
 	}
+};
 
-	template <typename IndexType>
-	inline detail::PMxArrayNative operator[](IndexType i) const {
-		return mxGetFieldByNumber(get_array(), 0, static_cast<int>(i));
+template <>
+struct ArgumentTraits<MxStruct> {
+	static inline bool isValid(const PMxArrayNative array) {
+		return mxIsStruct(array) && (mxGetNumberOfElements(array) == 1);
 	}
 
-	inline detail::PMxArrayNative operator[](const std::string& name) {
-		return mxGetField(get_array(), 0, name.c_str());
+	static inline std::string describe() {
+		return "1x1 struct";
 	}
+};
 
-	inline detail::PMxArrayNative operator[](const std::string& name) const {
-		return mxGetField(get_array(), 0, name.c_str());
+template <>
+struct ArgumentTraits<MxStructArray> {
+	static inline bool isValid(const PMxArrayNative array) {
+		return mxIsStruct(array);
 	}
 
-	inline const detail::PMxArrayNative* getData() const {
-		return static_cast<detail::PMxArrayNative*>(mxGetData(get_array()));
+	static inline std::string describe() {
+		return "struct";
 	}
+};
 
-	inline detail::PMxArrayNative* getData() {
-		return static_cast<detail::PMxArrayNative*>(mxGetData(get_array()));
+inline std::string describeArray(const PMxArrayNative array) {
+	std::string retArg = std::string(mxIsSparse(array) ? "sparse " : "")
+						+ std::string(mxIsComplex(array) ? "complex " : "")
+						+ getClassIdName(mxGetClassID(array)) + " of size ";
+	const mwSize* dims = mxGetDimensions(array);
+	for (mwSize iter = 0, end = mxGetNumberOfDimensions(array); iter < end;
+		++iter) {
+		retArg += ((iter == 0) ? "" : "x") + std::to_string(dims[iter]);
 	}
+	return retArg;
+}
 
-	inline void vectorize(std::vector<std::string>& vecName,
-						std::vector<detail::PMxArrayNative>& vecVar) const {
-		vecName.resize(0);
-		vecVar.resize(0);
-		for (int iter = 0, end = getNumberOfFields(); iter < end; ++iter) {
-			const char* tempName = mxGetFieldNameByNumber(get_array(), iter);
-			vecName.push_back(std::string(tempName));
-			detail::PMxArrayNative tempVar = mxGetFieldByNumber(get_array(), 0,
-																iter);
-			vecVar.push_back(tempVar);
+template <typename... Types>
+struct TypeList {};
+
+}  // namespace detail
+
+/*
+ * Input argument of a Signature: a wrapper type, and optionally its Dims.
+ */
+template <typename MxArrayType, typename DimsType = Dims<> >
+struct In {
+	typedef MxArrayType type;
+
+	/*
+	 * Checks array and wraps it, without copying. Raises an error naming the
+	 * (one-based) argument otherwise.
+	 */
+	static inline MxArrayType get(const mxArray* array, const size_t index) {
+		const detail::PMxArrayNative nativeArray =
+											const_cast<detail::PMxArrayNative>(array);
+		if (!detail::ArgumentTraits<MxArrayType>::isValid(nativeArray)
+			|| !DimsType::isValid(nativeArray)) {
+			reportInvalid(nativeArray, index);
 		}
+		return MxArrayType(nativeArray);
 	}
 
-	virtual ~MxStruct() = default;
 private:
-	static const size_t kMxMaxNameLength = mxMAXNAM - 1;
+	/*
+	 * Kept out of get, so that the check itself stays small enough to inline.
+	 */
+	static void reportInvalid(const detail::PMxArrayNative array,
+							const size_t index) {
+		const std::string dims = DimsType::describe();
+		const std::string message = "Input argument "
+			+ std::to_string(index + 1) + " must be "
+			+ detail::ArgumentTraits<MxArrayType>::describe()
+			+ (dims.empty() ? std::string() : " of size " + dims)
+			+ ", not " + detail::describeArray(array) + ".";
+		mexErrMsgIdAndTxt("MATLAB:mex", "%s\n", message.c_str());
+	}
+};
 
-	template <typename IndexType>
-	void addField_sub(const std::string* arrName,
-					const detail::PMxArrayNative* arrVar,
-					IndexType numFields) {
-		for (IndexType iter = 0; iter < numFields; ++iter) {
-			mexAssert(arrName[iter].size() <= kMxMaxNameLength);
-			mxAddField(get_array(), arrName[iter].c_str());
-			mxSetField(get_array(), 0, arrName[iter].c_str(), arrVar[iter]);
+/*
+ * Output argument of a Signature.
+ */
+template <typename MxArrayType>
+struct Out {
+	typedef MxArrayType type;
+};
+
+namespace detail {
+
+/*
+ * Splits the arguments of a Signature into its In and Out lists.
+ */
+template <typename InputList, typename OutputList, typename... Arguments>
+struct SignatureParts;
+
+template <typename... Inputs, typename... Outputs>
+struct SignatureParts<TypeList<Inputs...>, TypeList<Outputs...> > {
+	typedef TypeList<Inputs...> InputList;
+	typedef TypeList<Outputs...> OutputList;
+};
+
+template <typename... Inputs, typename... Outputs, typename MxArrayType,
+		typename DimsType, typename... Arguments>
+struct SignatureParts<TypeList<Inputs...>, TypeList<Outputs...>,
+					In<MxArrayType, DimsType>, Arguments...> :
+		SignatureParts<TypeList<Inputs..., In<MxArrayType, DimsType> >,
+					TypeList<Outputs...>, Arguments...> {};
+
+template <typename... Inputs, typename... Outputs, typename MxArrayType,
+		typename... Arguments>
+struct SignatureParts<TypeList<Inputs...>, TypeList<Outputs...>,
+					Out<MxArrayType>, Arguments...> :
+		SignatureParts<TypeList<Inputs...>,
+					TypeList<Outputs..., Out<MxArrayType> >, Arguments...> {};
+
+template <typename InputList, typename OutputList>
+class SignatureImpl;
+
+template <typename... Inputs, typename... Outputs>
+class SignatureImpl<TypeList<Inputs...>, TypeList<Outputs...> > {
+public:
+	typedef std::tuple<typename Inputs::type...> InputTuple;
+
+	static constexpr int kNumberOfInputs = sizeof...(Inputs);
+	static constexpr int kNumberOfOutputs = sizeof...(Outputs);
+	/*
+	 * MATLAB asks for one output, ans, even from functions that have none.
+	 */
+	static constexpr int kMaxNumberOfOutputs = (kNumberOfOutputs > 1)
+											? kNumberOfOutputs
+											: 1;
+
+	static inline InputTuple parse(const int nlhs, const int nrhs,
+								const mxArray* prhs[]) {
+		if (nrhs != kNumberOfInputs) {
+			mexErrMsgIdAndTxt("MATLAB:mex",
+							"Expected %d input arguments, got %d.\n",
+							kNumberOfInputs, nrhs);
+		}
+		if (nlhs > kMaxNumberOfOutputs) {
+			mexErrMsgIdAndTxt("MATLAB:mex",
+							"Expected at most %d output arguments, got %d.\n",
+							kMaxNumberOfOutputs, nlhs);
 		}
+		return parse(prhs,
+					typename MakeIndexSequence<sizeof...(Inputs)>::type());
 	}
 
-	template <typename IndexType>
-	void addField_sub(const std::string* arrName,
-					const detail::PMxArray* arrVar,
-					IndexType numFields) {
-		for (IndexType iter = 0; iter < numFields; ++iter) {
-			mexAssert(arrName[iter].size() <= kMxMaxNameLength);
-			mxAddField(get_array(), arrName[iter].c_str());
-			mxSetField(get_array(), 0, arrName[iter].c_str(),
-					arrVar[iter]->get_array());
-		}
+	template <size_t I, typename MxArrayType>
+	static inline void setOutput(mxArray* plhs[], const MxArrayType& value) {
+		typedef typename std::tuple_element<I,
+								std::tuple<typename Outputs::type...> >::type
+																	OutputType;
+		static_assert(std::is_base_of<OutputType, MxArrayType>::value,
+					"Value does not match the declared output type.");
+		plhs[I] = value.get_array();
+	}
+
+private:
+	template <size_t... Indices>
+	static inline InputTuple parse(const mxArray* prhs[],
+								IndexSequence<Indices...>) {
+		/*
+		 * Braced initialization evaluates the checks in argument order.
+		 */
+		return InputTuple{Inputs::get(prhs[Indices], Indices)...};
 	}
 };
 
+}  // namespace detail
+
+/*
+ * Compile-time description of the arguments of a mex function:
+ *
+ *   typedef mex::Signature<mex::In<mex::MxNumeric<double>, mex::Dims<-1, 3> >,
+ *                          mex::In<mex::MxString>,
+ *                          mex::Out<mex::MxStruct> > Sig;
+ *   const Sig::InputTuple inputs = Sig::parse(nlhs, nrhs, prhs);
+ *   const mex::MxNumeric<double>& points = std::get<0>(inputs);
+ *
+ * parse checks the numbers of arguments, then the class and dimensions of
+ * each input in order, and returns the inputs wrapped without copying, or
+ * raises an error that names the offending argument. setOutput<I> checks the
+ * type of output I at compile time.
+ */
+template <typename... Arguments>
+class Signature :
+		public detail::SignatureImpl<
+			typename detail::SignatureParts<detail::TypeList<>,
+											detail::TypeList<>,
+											Arguments...>::InputList,
+			typename detail::SignatureParts<detail::TypeList<>,
+											detail::TypeList<>,
+											Arguments...>::OutputList> {};
+
 template <typename T, typename U>
 class ConstMap {
 public:
@@ -955,28 +4647,224 @@ private:
 	std::map<U, T> m_mapRightToLeft;
 };
 
+namespace detail {
+
+const std::uint64_t kFnvOffset = UINT64_C(14695981039346656037);
+const std::uint64_t kFnvPrime = UINT64_C(1099511628211);
+
+/*
+ * FNV-1a hash of a NUL-terminated string, usable in constant expressions.
+ */
+constexpr std::uint64_t hashString(const char* key,
+								const std::uint64_t hash = kFnvOffset) {
+	return (*key == '\0')
+			? hash
+			: hashString(key + 1,
+						(hash ^ static_cast<unsigned char>(*key)) * kFnvPrime);
+}
+
+inline std::uint64_t hashString(const StringView& key) {
+	std::uint64_t hash = kFnvOffset;
+	for (size_t iter = 0, end = key.size(); iter < end; ++iter) {
+		hash = (hash ^ static_cast<unsigned char>(key[iter])) * kFnvPrime;
+	}
+	return hash;
+}
+
+/*
+ * Hashing and comparison of ConstFlatMap keys and values. Integral and enum
+ * types hash to themselves; string literals are looked up by StringView,
+ * so that std::string and const char* arguments both work.
+ */
+template <typename T>
+struct ConstMapTraits {
+	typedef T LookupType;
+
+	static constexpr std::uint64_t hash(const T key) {
+		return static_cast<std::uint64_t>(key);
+	}
+
+	static inline bool equals(const T key, const LookupType& other) {
+		return key == other;
+	}
+};
+
+template <>
+struct ConstMapTraits<const char*> {
+	typedef StringView LookupType;
+
+	static constexpr std::uint64_t hash(const char* key) {
+		return hashString(key);
+	}
+
+	static inline std::uint64_t hash(const StringView& key) {
+		return hashString(key);
+	}
+
+	static inline bool equals(const char* key, const LookupType& other) {
+		return other == StringView(key);
+	}
+};
+
+template <typename T, typename U>
+struct ConstMapEntry {
+	constexpr ConstMapEntry(const T key, const U value) :
+			m_key(key),
+			m_value(value),
+			m_keyHash(ConstMapTraits<T>::hash(key)),
+			m_valueHash(ConstMapTraits<U>::hash(value)) {}
+
+	T m_key;
+	U m_value;
+	std::uint64_t m_keyHash;
+	std::uint64_t m_valueHash;
+};
+
+}  // namespace detail
+
+/*
+ * Allocation-free alternative to ConstMap and ConstBiMap for small option
+ * tables, built in a constant expression with the same chained syntax:
+ *
+ *   constexpr auto kModes = mex::makeConstMap("fast", kFast)("exact", kExact);
+ *   const Mode mode = kModes[MxString(prhs[1]).get_view()];
+ *   const char* name = kModes.find(mode);
+ *
+ * Keys and values must be integral, enum, or const char* (string literal)
+ * types. Hashes of all entries are computed at compile time; a lookup hashes
+ * its argument once and scans the N hashes, comparing strings only on a hash
+ * match, which for option tables is cheaper than a tree walk.
+ */
+template <typename T, typename U, size_t N>
+class ConstFlatMap {
+private:
+	typedef detail::ConstMapTraits<T> KeyTraits;
+	typedef detail::ConstMapTraits<U> ValueTraits;
+
+public:
+	typedef typename KeyTraits::LookupType KeyLookupType;
+	typedef typename ValueTraits::LookupType ValueLookupType;
+
+	typedef detail::ConstMapEntry<T, U> Entry;
+
+	template <typename... EntryTypes>
+	constexpr explicit ConstFlatMap(const EntryTypes... entries) :
+			m_entries{entries...} {}
+
+	/// Consecutive insertion operator
+	constexpr ConstFlatMap<T, U, N + 1> operator()(const T key,
+												const U value) const {
+		return append(Entry(key, value),
+					typename detail::MakeIndexSequence<N>::type());
+	}
+
+	static constexpr size_t size() {
+		return N;
+	}
+
+	constexpr const Entry& get_entry(const size_t i) const {
+		return m_entries[i];
+	}
+
+	inline bool contains(const KeyLookupType& key) const {
+		return findKey(key) != nullptr;
+	}
+
+	/// Lookup operator; fail if not found
+	inline U operator[](const KeyLookupType& key) const {
+		const Entry* entry = findKey(key);
+		if (entry == nullptr) {
+			mexErrMsgIdAndTxt("MATLAB:mex", "Value not found.\n");
+		}
+		return entry->m_value;
+	}
+
+	/// Reverse lookup; fail if not found
+	inline T find(const ValueLookupType& value) const {
+		const std::uint64_t hash = ValueTraits::hash(value);
+		for (size_t iter = 0; iter < N; ++iter) {
+			if ((m_entries[iter].m_valueHash == hash)
+				&& ValueTraits::equals(m_entries[iter].m_value, value)) {
+				return m_entries[iter].m_key;
+			}
+		}
+		mexErrMsgIdAndTxt("MATLAB:mex", "Key not found.\n");
+		return T();
+	}
+
+private:
+	template <size_t... Indices>
+	constexpr ConstFlatMap<T, U, N + 1> append(const Entry& entry,
+								detail::IndexSequence<Indices...>) const {
+		return ConstFlatMap<T, U, N + 1>(m_entries[Indices]..., entry);
+	}
+
+	inline const Entry* findKey(const KeyLookupType& key) const {
+		const std::uint64_t hash = KeyTraits::hash(key);
+		for (size_t iter = 0; iter < N; ++iter) {
+			if ((m_entries[iter].m_keyHash == hash)
+				&& KeyTraits::equals(m_entries[iter].m_key, key)) {
+				return &m_entries[iter];
+			}
+		}
+		return nullptr;
+	}
+
+	Entry m_entries[N];
+};
+
+template <typename T, typename U>
+constexpr ConstFlatMap<T, U, 1> makeConstMap(const T key, const U value) {
+	return ConstFlatMap<T, U, 1>(detail::ConstMapEntry<T, U>(key, value));
+}
+
 class MxArrayHeader {
 public:
 	explicit MxArrayHeader(const MxArray& mxArray) :
-			m_size(mxArray.size()),
-			m_dimensions(mxArray.getDimensions()),
+			m_size(mxArray.size<mwSize>()),
+			m_dimensions(mxArray.getDimensions<mwSize>()),
 			m_class(mxArray.getClass()) {}
 
 	explicit MxArrayHeader(const detail::PMxArrayNative array) :
 			MxArrayHeader(MxArray(array)) {}
 
+	MxArrayHeader(const mxClassID classId, const std::vector<mwSize>& dims) :
+			m_size(std::accumulate(dims.begin(), dims.end(), mwSize(1),
+									std::multiplies<mwSize>())),
+			m_dimensions(dims),
+			m_class(classId) {}
+
 	MxArrayHeader() = default;
 	MxArrayHeader(const MxArrayHeader& other) = default;
 	MxArrayHeader& operator=(const MxArrayHeader& other) = default;
 	MxArrayHeader(MxArrayHeader&& other) = default;
 	MxArrayHeader& operator=(MxArrayHeader&& other) = default;
 
+	template <typename IndexType>
+	inline IndexType getNumberOfElements() const {
+		return static_cast<IndexType>(m_size);
+	}
+
+	inline int getNumberOfElements() const {
+		return getNumberOfElements<int>();
+	}
+
+	template <typename IndexType>
+	inline std::vector<IndexType> getDimensions() const {
+		return std::vector<IndexType>(m_dimensions.begin(), m_dimensions.end());
+	}
+
 	inline std::vector<int> getDimensions() const {
-		return m_dimensions;
+		return getDimensions<int>();
+	}
+
+	template <typename IndexType>
+	inline IndexType getNumberOfDimensions() const {
+		return static_cast<IndexType>(m_dimensions.size());
 	}
 
 	inline int getNumberOfDimensions() const {
-		return m_dimensions.size();
+		return getNumberOfDimensions<int>();
 	}
 
 	inline mxClassID getClass() const {
@@ -1000,8 +4888,8 @@ public:
 		return (getClass() == MxStructClass::m_classId);
 	}
 private:
-	const int m_size;
-	const std::vector<int> m_dimensions;
+	const mwSize m_size;
+	const std::vector<mwSize> m_dimensions;
 	const mxClassID m_class;
 };
 
@@ -1016,7 +4904,7 @@ struct MxVariableHeader {
 
 struct MxVariable {
 	const std::string m_name;
-	const MxArray* m_array;
+	const MxArray m_array;
 };
 
 //class MxAttributeInterface {
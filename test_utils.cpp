@@ -5,10 +5,12 @@
  *      Author: igkiou
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "mex_utils.h"
-//#include "mat_utils.h"
+#include "mat_utils.h"
 
 mex::MxString test() {
 	return mex::MxString("gkiou");
@@ -36,6 +38,191 @@ inline std::ostream& operator << (std::ostream& os, const std::vector<T>& v)
     return os;
 }
 
+struct SumElements {
+	template <typename NumericType>
+	double operator()(const mex::MxNumeric<NumericType>& array) const {
+		double sum = 0;
+		for (int iter = 0; iter < array.getNumberOfElements(); ++iter) {
+			sum += static_cast<double>(array[iter]);
+		}
+		return sum;
+	}
+};
+
+namespace {
+
+/*
+ * Writes both variables with MatParallelOutputFile and reads them back with
+ * MatMappedFile. large should span several detail::kMatDeflateBlockSize
+ * blocks, so that the dictionary-primed blocks are checked too.
+ */
+void testParallelRoundTrip(const mex::MxNumeric<float>& small,
+						const mex::MxNumeric<double>& large,
+						const int compressionLevel) {
+	{
+		mex::MatParallelOutputFile file("test_utils.mat", compressionLevel);
+		file.writeVariable(small, "small");
+		file.writeVariable(large, "large");
+		file.flush();
+	}
+	const mex::MatMappedFile file("test_utils.mat");
+	mex::MxNumeric<float> smallRead = file.readNumeric<float>("small");
+	mex::MxNumeric<double> largeRead = file.readNumeric<double>("large");
+	const bool isEqual = (smallRead.getDimensions() == small.getDimensions())
+					&& std::equal(small.getData(),
+								small.getData() + small.getNumberOfElements(),
+								smallRead.getData())
+					&& (largeRead.getDimensions() == large.getDimensions())
+					&& std::equal(large.getData(),
+								large.getData() + large.getNumberOfElements(),
+								largeRead.getData());
+	smallRead.destroy();
+	largeRead.destroy();
+	mexAssertEx(isEqual, "MatParallelOutputFile round trip does not match");
+}
+
+/*
+ * Maps the file that testParallelRoundTrip wrote at level 0, whose variables
+ * are stored uncompressed, and reads small through a zero-copy view.
+ */
+void testMappedView(const mex::MxNumeric<float>& small) {
+	const mex::MatMappedFile file("test_utils.mat");
+	mexAssertEx(file.isMappable("small") && file.isMappable("large"),
+				"Uncompressed variables are not mappable");
+	const mex::MxNumericView<const float> view = file.getView<float>("small");
+	const bool isEqual = (view.getDimensions() == small.getDimensions())
+					&& std::equal(view.begin(), view.end(), small.getData());
+	mexAssertEx(isEqual, "MatMappedFile view does not match");
+}
+
+/*
+ * Queries the index of the file written by testParallelRoundTrip, before and
+ * after writing and deleting variables.
+ */
+void testVariableIndex(const mex::MxNumeric<float>& small) {
+	mex::MatFile file("test_utils.mat");
+	const bool isIndexed = file.hasVariable("small") && file.hasVariable("large")
+						&& !file.hasVariable("written")
+						&& (file.getVariableNames()
+							== std::vector<std::string>{"small", "large"})
+						&& (file.getVariableInfo("small").getDimensions()
+							== small.getDimensions());
+	mexAssertEx(isIndexed, "MatFile index does not match the file");
+	file.writeVariable(small, "written");
+	file.deleteVariable("large");
+	const bool isUpdated = file.hasVariable("written")
+						&& !file.hasVariable("large")
+						&& (file.getVariableNames()
+							== std::vector<std::string>{"small", "written"});
+	mexAssertEx(isUpdated, "MatFile index is not updated by writeVariable and "
+				"deleteVariable");
+}
+
+#ifdef MAT_UTILS_USE_HDF5
+/*
+ * Streams a growable variable into a v7.3 file slice by slice, and reads a
+ * block that spans several slices back.
+ */
+void testVariableStream() {
+	const mwSize numRows = 6;
+	const mwSize numColumns = 4;
+	const mwSize numSlices = 5;
+	{
+		mex::MatOutputFile file("test_utils_v73.mat");
+		mex::MatVariableStream<INT32_T> stream =
+						file.createVariableStream<INT32_T>("streamed",
+									std::vector<mwSize>{numRows, numColumns, 0},
+									1);
+		std::vector<INT32_T> slice(numRows * numColumns);
+		for (mwSize iterSlice = 0; iterSlice < numSlices; ++iterSlice) {
+			for (mwSize iter = 0, end = slice.size(); iter < end; ++iter) {
+				slice[iter] = static_cast<INT32_T>(100 * iterSlice + iter);
+			}
+			stream.append(slice.data(), 1);
+		}
+		mexAssertEx(stream.getNumberOfSlices() == numSlices,
+					"MatVariableStream lost slices");
+		stream.close();
+	}
+	const mex::MatInputFile file("test_utils_v73.mat");
+	const std::vector<mwSize> offsets{1, 2, 1};
+	const std::vector<mwSize> counts{4, 2, 3};
+	mex::MxNumeric<INT32_T> block = file.readVariableBlock<INT32_T>("streamed",
+																offsets,
+																counts);
+	bool isEqual = (block.getDimensions<mwSize>() == counts);
+	for (mwSize iterSlice = 0; iterSlice < counts[2]; ++iterSlice) {
+		for (mwSize iterColumn = 0; iterColumn < counts[1]; ++iterColumn) {
+			for (mwSize iterRow = 0; iterRow < counts[0]; ++iterRow) {
+				const mwSize expected = 100 * (offsets[2] + iterSlice)
+									+ numRows * (offsets[1] + iterColumn)
+									+ offsets[0] + iterRow;
+				isEqual = isEqual && (static_cast<mwSize>(block[iterRow
+										+ counts[0] * (iterColumn
+										+ counts[1] * iterSlice)])
+									== expected);
+			}
+		}
+	}
+	block.destroy();
+	mexAssertEx(isEqual, "MatVariableStream and readVariableBlock round trip "
+				"does not match");
+}
+#endif
+
+bool isSameArray(const mex::MxArray& array, const mex::MxArray& other) {
+	if ((array.getClass() != other.getClass())
+		|| (array.getDimensions<mwSize>() != other.getDimensions<mwSize>())) {
+		return false;
+	}
+	const char* data = static_cast<const char*>(mxGetData(array.get_array()));
+	const char* otherData = static_cast<const char*>(
+												mxGetData(other.get_array()));
+	return std::equal(data, data + array.getNumberOfElements<size_t>()
+										* mxGetElementSize(array.get_array()),
+					otherData);
+}
+
+/*
+ * Loads variables of the file left by testVariableIndex (uncompressed small
+ * and written through the MAT-file API), of a compressed v7 file, and of the
+ * v7.3 file of testVariableStream, in one batch, including a string, and
+ * checks each against MatFile::readVariable.
+ */
+void testBatchLoad(const mex::MxNumeric<float>& small) {
+	{
+		mex::MatParallelOutputFile file("test_utils_v7.mat",
+										Z_DEFAULT_COMPRESSION);
+		file.writeVariable(small, "compressed");
+		file.flush();
+	}
+	{
+		mex::MatFile file("test_utils.mat");
+		file.writeVariable(mex::MxString("gkiou"), "string");
+	}
+	const std::vector<mex::MatLoadRequest> requests{
+		{"test_utils.mat", "small"},
+		{"test_utils_v7.mat", "compressed"},
+		{"test_utils.mat", "string"},
+		{"test_utils.mat", "written"},
+#ifdef MAT_UTILS_USE_HDF5
+		{"test_utils_v73.mat", "streamed"},
+#endif
+	};
+	std::vector<mex::MxArray> loaded = mex::loadVariables(requests);
+	bool isEqual = (loaded.size() == requests.size());
+	for (size_t iter = 0, end = requests.size(); iter < end; ++iter) {
+		const mex::MatInputFile file(requests[iter].m_fileName);
+		mex::MxArray read = file.readVariable(requests[iter].m_variableName);
+		isEqual = isEqual && isSameArray(loaded[iter], read);
+		read.destroy();
+		loaded[iter].destroy();
+	}
+	mexAssertEx(isEqual, "loadVariables does not match MatFile::readVariable");
+}
+
+}  // namespace
+
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 
 	int height = 10;
@@ -55,6 +242,8 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 	vec.push_back(20);
 	vec.push_back(30);
 	plhs[3] = mex::MxNumeric<float>(vec).get_array();
+	mex::MxVector<float> adoptedVec(vec.begin(), vec.end());
+	plhs[14] = mex::MxNumeric<float>(std::move(adoptedVec)).get_array();
 	mex::MxNumeric<int> foo(height, width);
 	foo.getData()[0] = 10;
 	plhs[4] = foo.get_array();
@@ -79,16 +268,26 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 	names.push_back("field1");
 	names.push_back("field2");
 	names.push_back("field3");
-	mex::MxArray* tempp = new mex::MxNumeric<float>(height,width);
-	vars.push_back(tempp);
-	tempp = new mex::MxNumeric<bool>(height,width);
-	vars.push_back(tempp);
-	tempp = new mex::MxString("field");
-	vars.push_back(tempp);
-	plhs[12] = mex::MxStruct(names, vars).get_array();
-	delete vars[0];
-	delete vars[1];
-	delete vars[2];
+	mex::MxNumeric<float> field1(height, width);
+	mex::MxNumeric<bool> field2(height, width);
+	mex::MxString field3("field");
+	vars.push_back(&field1);
+	vars.push_back(&field2);
+	vars.push_back(&field3);
+	mex::MxUniqueArray<mex::MxStruct> structArray(mex::MxStruct(names, vars));
+	plhs[12] = structArray.release();
+	mex::MxCellString nameCell(names);
+	const mex::StringTable nameTable = nameCell.extract();
+	bool isExtracted = (nameTable.size() == names.size());
+	for (size_t iter = 0, end = nameTable.size(); iter < end; ++iter) {
+		std::cout << "name " << iter << " " << nameTable.c_str(iter) << std::endl;
+		isExtracted = isExtracted && (nameTable.c_str(iter) == names[iter]);
+	}
+	mexAssertEx(isExtracted, "MxCellString::extract does not match the names");
+	plhs[15] = nameCell.get_array();
+	mex::MxUniqueArray<mex::MxNumeric<double> > scratch =
+				mex::makeUnique<mex::MxNumeric<double> >(height, width);
+	(*scratch)[0] = 1.0;
 	std::vector<int> dims;
 	dims.push_back(10);
 	dims.push_back(5);
@@ -103,9 +302,34 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 	perm.push_back(3);
 	plhs[0] = temp.permute(perm).get_array();
 	plhs[1] = temp.get_array();
+	const double sum = mex::visitNumeric(temp, SumElements());
+	std::cout << "sum " << sum << std::endl;
+	double expectedSum = 0;
+	for (int iter = 0; iter < temp.getNumberOfElements(); ++iter) {
+		expectedSum += static_cast<double>(temp[iter]);
+	}
+	mexAssertEx(std::fabs(sum - expectedSum) <= 1e-9 * std::fabs(expectedSum),
+				"visitNumeric sum does not match");
+	mex::MxNumericView<float> tempView(temp);
+	plhs[13] = tempView.permute(perm).slice(2, 0, 1).materialize().get_array();
 	double* a = (double*) malloc(100 * sizeof(double));
 	double* b = (double*) malloc(100 * sizeof(double));
 	memcpy(a, b, 100 * sizeof(double));
+	const int numLarge = static_cast<int>(
+				3 * mex::detail::kMatDeflateBlockSize / sizeof(double) + 1000);
+	mex::MxNumeric<double> large(numLarge, 1);
+	for (int iter = 0; iter < large.getNumberOfElements(); ++iter) {
+		large[iter] = (iter * 7919) % 1000;
+	}
+	testParallelRoundTrip(temp, large, Z_DEFAULT_COMPRESSION);
+	testParallelRoundTrip(temp, large, 0);
+	large.destroy();
+	testMappedView(temp);
+	testVariableIndex(temp);
+#ifdef MAT_UTILS_USE_HDF5
+	testVariableStream();
+#endif
+	testBatchLoad(temp);
 //	mex::MatFile file("test.mat", "r");
 //	std::vector<std::string> varnames = file.getVariableNames();
 //	std::cout << "number of variables: " << varnames.size() << std::endl;